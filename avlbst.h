@@ -5,14 +5,20 @@
 #include <exception>
 #include <cstdlib>
 #include <algorithm>
+#include <future>
+#include <iterator>
+#include <thread>
+#include <vector>
 #include "bst.h"
+#include "frozen.h"
 
 struct KeyError { };
 
 /**
 * A special kind of node for an AVL tree, which adds the height as a data member, plus
-* other additional helper functions. You do NOT need to implement any functionality or
-* add additional data members or helper functions.
+* other additional helper functions. The height is stored in a single byte (an AVL tree
+* of 2^64 nodes is under 94 levels tall) and, together with the number of nodes in the
+* subtree, packs into the padding after the item, so the order statistics cost no space.
 */
 template <typename Key, typename Value>
 class AVLNode : public Node<Key, Value>
@@ -20,21 +26,27 @@ class AVLNode : public Node<Key, Value>
 public:
     // Constructor/destructor.
     AVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent);
-    virtual ~AVLNode();
+    template<typename... Args> AVLNode(AVLNode<Key, Value>* parent, Args&&... args);
+    ~AVLNode();
 
     // Getter/setter for the node's height.
     int getHeight () const;
     void setHeight (int height);
 
-    // Getters for parent, left, and right. These need to be redefined since they
+    // Getter/setter for the number of nodes in the subtree rooted here.
+    unsigned int getSize () const;
+    void setSize (unsigned int size);
+
+    // Getters for parent, left, and right. These hide the ones in Node since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
     // for more information.
-    virtual AVLNode<Key, Value>* getParent() const override;
-    virtual AVLNode<Key, Value>* getLeft() const override;
-    virtual AVLNode<Key, Value>* getRight() const override;
+    AVLNode<Key, Value>* getParent() const;
+    AVLNode<Key, Value>* getLeft() const;
+    AVLNode<Key, Value>* getRight() const;
 
 protected:
-    int height_;
+    unsigned int size_;
+    signed char height_;
 };
 
 /*
@@ -48,7 +60,18 @@ protected:
 */
 template<class Key, class Value>
 AVLNode<Key, Value>::AVLNode(const Key& key, const Value& value, AVLNode<Key, Value> *parent) :
-    Node<Key, Value>(key, value, parent), height_(1)
+    Node<Key, Value>(key, value, parent), size_(1), height_(1)
+{
+
+}
+
+/**
+* A constructor that builds the item in place, see the matching Node constructor.
+*/
+template<class Key, class Value>
+template<typename... Args>
+AVLNode<Key, Value>::AVLNode(AVLNode<Key, Value>* parent, Args&&... args) :
+    Node<Key, Value>(parent, std::forward<Args>(args)...), size_(1), height_(1)
 {
 
 }
@@ -77,11 +100,29 @@ int AVLNode<Key, Value>::getHeight() const
 template<class Key, class Value>
 void AVLNode<Key, Value>::setHeight(int height)
 {
-    height_ = height;
+    height_ = static_cast<signed char>(height);
+}
+
+/**
+* A getter for the subtree size of a AVLNode.
+*/
+template<class Key, class Value>
+unsigned int AVLNode<Key, Value>::getSize() const
+{
+    return size_;
+}
+
+/**
+* A setter for the subtree size of a AVLNode.
+*/
+template<class Key, class Value>
+void AVLNode<Key, Value>::setSize(unsigned int size)
+{
+    size_ = size;
 }
 
 /**
-* An overridden function for getting the parent since a static_cast is necessary to make sure
+* A hiding function for getting the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
 */
 template<class Key, class Value>
@@ -91,7 +132,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getParent() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
@@ -100,7 +141,7 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getLeft() const
 }
 
 /**
-* Overridden for the same reasons as above.
+* Hidden for the same reasons as above.
 */
 template<class Key, class Value>
 AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
@@ -116,20 +157,102 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+template <class Key, class Value, class Alloc = NodeArena>
+class AVLTree : public BinarySearchTree<Key, Value, Alloc>
 {
 public:
+    typedef typename BinarySearchTree<Key, Value, Alloc>::iterator iterator;
+
+    AVLTree();
+    AVLTree(const AVLTree<Key, Value, Alloc>& other);
+    AVLTree(AVLTree<Key, Value, Alloc>&& other);
+    template<typename ForwardIt> AVLTree(ForwardIt first, ForwardIt last);
+    virtual ~AVLTree();
+    AVLTree<Key, Value, Alloc>& operator=(const AVLTree<Key, Value, Alloc>& other);
+    AVLTree<Key, Value, Alloc>& operator=(AVLTree<Key, Value, Alloc>&& other);
     virtual void insert (const std::pair<const Key, Value>& new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+
+    // Each of these makes a single descent and returns the item's position and
+    // whether it was newly inserted, like the std::map members of the same name.
+    template<typename... Args> std::pair<iterator, bool> try_emplace(const Key& key, Args&&... args);
+    template<typename... Args> std::pair<iterator, bool> try_emplace(Key&& key, Args&&... args);
+    template<typename M> std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value);
+    template<typename M> std::pair<iterator, bool> insert_or_assign(Key&& key, M&& value);
+    template<typename... Args> std::pair<iterator, bool> emplace(Args&&... args);
+
+    // Replaces the contents with the items in [first, last), see the definition.
+    template<typename ForwardIt> void assign(ForwardIt first, ForwardIt last);
+
+    // Set operations on the keys, built on join and split. other is copied into
+    // this tree's allocator first, so each costs O(|other|) for the copy plus
+    // O(m log(n/m + 1)) for the merge itself. With parallel set, large inputs
+    // are merged with fork-join recursion, forking only in the top
+    // log2(hardware threads) levels. Under BST_THREADED the next/prev threads
+    // are then rebuilt over the whole result, an extra O(n) walk.
+    void unionWith(const AVLTree<Key, Value, Alloc>& other, bool parallel = false);
+    void intersectWith(const AVLTree<Key, Value, Alloc>& other, bool parallel = false);
+    void differenceWith(const AVLTree<Key, Value, Alloc>& other, bool parallel = false);
+
+    // Batched updates: the batch is sorted once and merged in with a single
+    // union or difference, so rebalancing is shared across the whole batch
+    // instead of paid per key. insertBatch takes key/value pairs and behaves
+    // like inserting them one by one; removeBatch takes keys. parallel forks
+    // as the set operations do. Under BST_THREADED a batch merged this way
+    // also pays O(n) to rethread the tree; a small one inserted or removed
+    // key by key does not.
+    template<typename ForwardIt> void insertBatch(ForwardIt first, ForwardIt last, bool parallel = false);
+    template<typename ForwardIt> void removeBatch(ForwardIt first, ForwardIt last, bool parallel = false);
+
+    // Cuts [lo, hi) out with two splits and a join, see the definition.
+    virtual std::size_t erase(const Key& lo, const Key& hi);
+
+    // A read-only, pointer-free copy for lookup-heavy use, see frozen.h.
+    FrozenTree<Key, Value> freeze() const;
+
+    // Order statistics, all O(log n) using the subtree sizes.
+    iterator select(std::size_t k) const;
+    template<typename K> std::size_t rank(const K& key) const;
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
     // Add helper functions here
-    void add(const std::pair<const Key, Value>& keyValuePair); 
-    void updateHeights(AVLNode<Key,Value>* newNode); 
-    AVLNode<Key,Value>* findImbalance(AVLNode<Key,Value>* newNode); 
-    void checkImbalance(AVLNode<Key,Value>*& z, AVLNode<Key,Value>*&y, AVLNode<Key,Value>*&x); 
+    template<typename K> AVLNode<Key,Value>* findSlot(const K& key, AVLNode<Key,Value>*& parent, bool& goLeft) const;
+    void linkNew(AVLNode<Key,Value>* node, AVLNode<Key,Value>* parent, bool goLeft);
+    template<typename K, typename... Args> std::pair<iterator, bool> emplaceKey(K&& key, Args&&... args);
+    template<typename... Args> AVLNode<Key,Value>* createNode(AVLNode<Key,Value>* parent, Args&&... args);
+    virtual void destroyNode(Node<Key,Value>* node);
+    virtual Node<Key,Value>* cloneNode(const Node<Key,Value>* src, Node<Key,Value>* parent);
+    void retrace(AVLNode<Key,Value>* node);
+    void rotate(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x);
+    template<typename ForwardIt> void buildFromSorted(ForwardIt first, std::size_t n);
+    template<typename ForwardIt> AVLNode<Key,Value>* buildRange(ForwardIt& it, std::size_t n);
+    static std::size_t sortUnique(std::vector<std::pair<Key, Value> >& items);
+    // Join-based primitives on detached subtrees
+    static const std::size_t parallelCutoff = 1 << 14;
+    static int forkDepth(bool parallel);
+    // batches this many times smaller than the tree go in key by key, in order
+    static const std::size_t smallBatchRatio = 64;
+    static AVLNode<Key,Value>* makeNode(AVLNode<Key,Value>* left, AVLNode<Key,Value>* node, AVLNode<Key,Value>* right);
+    static AVLNode<Key,Value>* rotateLeftSub(AVLNode<Key,Value>* node);
+    static AVLNode<Key,Value>* rotateRightSub(AVLNode<Key,Value>* node);
+    static AVLNode<Key,Value>* joinRight(AVLNode<Key,Value>* left, AVLNode<Key,Value>* middle, AVLNode<Key,Value>* right);
+    static AVLNode<Key,Value>* joinLeft(AVLNode<Key,Value>* left, AVLNode<Key,Value>* middle, AVLNode<Key,Value>* right);
+    static AVLNode<Key,Value>* join(AVLNode<Key,Value>* left, AVLNode<Key,Value>* middle, AVLNode<Key,Value>* right);
+    static AVLNode<Key,Value>* join2(AVLNode<Key,Value>* left, AVLNode<Key,Value>* right);
+    static AVLNode<Key,Value>* splitLast(AVLNode<Key,Value>* node, AVLNode<Key,Value>*& last);
+    template<typename K> static AVLNode<Key,Value>* split(AVLNode<Key,Value>* node, const K& key, AVLNode<Key,Value>*& left, AVLNode<Key,Value>*& right);
+    static AVLNode<Key,Value>* unionNodes(AVLNode<Key,Value>* t1, AVLNode<Key,Value>* t2, std::vector<AVLNode<Key,Value>*>& dropped, int forks);
+    static AVLNode<Key,Value>* intersectNodes(AVLNode<Key,Value>* t1, AVLNode<Key,Value>* t2, std::vector<AVLNode<Key,Value>*>& dropped, int forks);
+    static AVLNode<Key,Value>* differenceNodes(AVLNode<Key,Value>* t1, AVLNode<Key,Value>* t2, std::vector<AVLNode<Key,Value>*>& dropped, int forks);
+    static AVLNode<Key,Value>* differenceKeys(AVLNode<Key,Value>* t, const Key* keys, std::size_t n, std::vector<AVLNode<Key,Value>*>& dropped, int forks);
+    void setRoot(AVLNode<Key,Value>* root, std::vector<AVLNode<Key,Value>*>& dropped);
+    AVLNode<Key,Value>* borrow(const AVLTree<Key, Value, Alloc>& other);
+
+    static int nodeHeight(AVLNode<Key,Value>* node);
+    static std::size_t nodeSize(AVLNode<Key,Value>* node);
+    static void updateSize(AVLNode<Key,Value>* node);
+    static void adjustSizes(AVLNode<Key,Value>* node, int delta);
     int imbalanceType(AVLNode<Key,Value>*& z, AVLNode<Key,Value>*&y, AVLNode<Key,Value>*&x);
     void zigzigRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x);
     void zigzigLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x); 
@@ -137,29 +260,293 @@ protected:
     void zigzagLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x);
     AVLNode<Key, Value>* getTallerChild(AVLNode<Key,Value>* node); 
     AVLNode<Key,Value>* breakTies(AVLNode<Key,Value>* y, AVLNode<Key,Value>* z);
-    void changeHeights(AVLNode<Key,Value>*z, AVLNode<Key,Value>*y);
 
 
 };
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+/**
+* Default constructor, which sizes the allocator for AVLNodes.
+*/
+template<class Key, class Value, class Alloc>
+AVLTree<Key, Value, Alloc>::AVLTree() :
+    BinarySearchTree<Key, Value, Alloc>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>))
 {
-    // TODO
-    add(new_item); 
-    Node<Key, Value>* newNode = BinarySearchTree<Key,Value>::internalFind(new_item.first);
-    static_cast<AVLNode<Key, Value>*>(newNode)->setHeight(0);
-    updateHeights(static_cast<AVLNode<Key, Value>*>(newNode)); 
 
-    if (BinarySearchTree<Key,Value>::isBalanced() == true) {
-        return;
+}
+
+/**
+* Deep copy, heights included.
+*/
+template<class Key, class Value, class Alloc>
+AVLTree<Key, Value, Alloc>::AVLTree(const AVLTree<Key, Value, Alloc>& other) :
+    BinarySearchTree<Key, Value, Alloc>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>))
+{
+    this->root_ = this->cloneTree(other.root_);
+    this->size_ = other.size_;
+}
+
+template<class Key, class Value, class Alloc>
+AVLTree<Key, Value, Alloc>::AVLTree(AVLTree<Key, Value, Alloc>&& other) :
+    BinarySearchTree<Key, Value, Alloc>(std::move(other))
+{
+
+}
+
+/**
+* Builds the tree from a range of key/value pairs, see assign().
+*/
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+AVLTree<Key, Value, Alloc>::AVLTree(ForwardIt first, ForwardIt last) :
+    BinarySearchTree<Key, Value, Alloc>(sizeof(AVLNode<Key, Value>), alignof(AVLNode<Key, Value>))
+{
+    assign(first, last);
+}
+
+/**
+* Clears here rather than leaving it to the base destructor, so that the
+* nodes are destroyed as AVLNodes.
+*/
+template<class Key, class Value, class Alloc>
+AVLTree<Key, Value, Alloc>::~AVLTree()
+{
+    this->clear();
+}
+
+template<class Key, class Value, class Alloc>
+AVLTree<Key, Value, Alloc>& AVLTree<Key, Value, Alloc>::operator=(const AVLTree<Key, Value, Alloc>& other)
+{
+    BinarySearchTree<Key, Value, Alloc>::operator=(other);
+    return *this;
+}
+
+template<class Key, class Value, class Alloc>
+AVLTree<Key, Value, Alloc>& AVLTree<Key, Value, Alloc>::operator=(AVLTree<Key, Value, Alloc>&& other)
+{
+    BinarySearchTree<Key, Value, Alloc>::operator=(std::move(other));
+    return *this;
+}
+
+/**
+* Inserts the item and rebalances by retracing from the new node's parent only,
+* so the cost is O(log n). If the key already exists only its value is updated.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::insert(const std::pair<const Key, Value>& new_item)
+{
+    insert_or_assign(new_item.first, new_item.second);
+}
+
+/**
+* Inserts a value built from args unless the key already exists, in which case
+* nothing is constructed and the tree is unchanged.
+*/
+template<class Key, class Value, class Alloc>
+template<typename... Args>
+std::pair<typename AVLTree<Key, Value, Alloc>::iterator, bool>
+AVLTree<Key, Value, Alloc>::try_emplace(const Key& key, Args&&... args)
+{
+    return emplaceKey(key, std::forward<Args>(args)...);
+}
+
+template<class Key, class Value, class Alloc>
+template<typename... Args>
+std::pair<typename AVLTree<Key, Value, Alloc>::iterator, bool>
+AVLTree<Key, Value, Alloc>::try_emplace(Key&& key, Args&&... args)
+{
+    return emplaceKey(std::move(key), std::forward<Args>(args)...);
+}
+
+/**
+* Inserts the value, or assigns it over the existing value if the key is present.
+*/
+template<class Key, class Value, class Alloc>
+template<typename M>
+std::pair<typename AVLTree<Key, Value, Alloc>::iterator, bool>
+AVLTree<Key, Value, Alloc>::insert_or_assign(const Key& key, M&& value)
+{
+    std::pair<iterator, bool> result = emplaceKey(key, std::forward<M>(value));
+    if (!result.second) result.first->second = std::forward<M>(value);
+    return result;
+}
+
+template<class Key, class Value, class Alloc>
+template<typename M>
+std::pair<typename AVLTree<Key, Value, Alloc>::iterator, bool>
+AVLTree<Key, Value, Alloc>::insert_or_assign(Key&& key, M&& value)
+{
+    std::pair<iterator, bool> result = emplaceKey(std::move(key), std::forward<M>(value));
+    if (!result.second) result.first->second = std::forward<M>(value);
+    return result;
+}
+
+/**
+* Builds the item from args (as std::pair would) and inserts it if its key is not
+* already present. Like std::map::emplace the item has to exist before its key can
+* be searched for, so it is thrown away again when the key is a duplicate.
+*/
+template<class Key, class Value, class Alloc>
+template<typename... Args>
+std::pair<typename AVLTree<Key, Value, Alloc>::iterator, bool>
+AVLTree<Key, Value, Alloc>::emplace(Args&&... args)
+{
+    AVLNode<Key, Value>* node = createNode(NULL, std::forward<Args>(args)...);
+    AVLNode<Key, Value>* parent;
+    bool goLeft;
+    AVLNode<Key, Value>* existing = findSlot(node->getKey(), parent, goLeft);
+    if (existing != NULL) {
+        destroyNode(node);
+        return std::make_pair(this->makeIterator(existing), false);
+    }
+    linkNew(node, parent, goLeft);
+    return std::make_pair(this->makeIterator(node), true);
+}
+
+/**
+* Descends once looking for key. Returns the node holding it, or NULL along with
+* the parent and side of the empty spot where it would go.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+AVLNode<Key, Value>*
+AVLTree<Key, Value, Alloc>::findSlot(const K& key, AVLNode<Key,Value>*& parent, bool& goLeft) const
+{
+    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_);
+    parent = NULL;
+    goLeft = false;
+    while (curr != NULL) {
+        parent = curr;
+        goLeft = key < curr->getKey();
+        if (!goLeft && !(curr->getKey() < key)) return curr;
+        curr = goLeft ? curr->getLeft() : curr->getRight();
     }
+    return NULL;
+}
+
+/**
+* Hangs a new leaf off the spot found by findSlot() and rebalances above it.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::linkNew(AVLNode<Key,Value>* node, AVLNode<Key,Value>* parent, bool goLeft)
+{
+    node->setParent(parent);
+    if (parent == NULL) this->root_ = node;
+    else if (goLeft) parent->setLeft(node);
+    else parent->setRight(node);
+    this->threadInsert(node, parent, goLeft);
+    adjustSizes(parent, 1);
+    this->size_++;
+    retrace(parent);
+}
+
+/**
+* The shared single-descent insert: the node is only constructed, with the key
+* moved in when possible, once we know the key is missing.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K, typename... Args>
+std::pair<typename AVLTree<Key, Value, Alloc>::iterator, bool>
+AVLTree<Key, Value, Alloc>::emplaceKey(K&& key, Args&&... args)
+{
+    AVLNode<Key, Value>* parent;
+    bool goLeft;
+    AVLNode<Key, Value>* existing = findSlot(key, parent, goLeft);
+    if (existing != NULL) return std::make_pair(this->makeIterator(existing), false);
+
+    AVLNode<Key, Value>* node = createNode(parent, std::piecewise_construct,
+        std::forward_as_tuple(std::forward<K>(key)), std::forward_as_tuple(std::forward<Args>(args)...));
+    linkNew(node, parent, goLeft);
+    return std::make_pair(this->makeIterator(node), true);
+}
+
 
-    AVLNode<Key, Value>* z = findImbalance(static_cast<AVLNode<Key, Value>*>(newNode));
-    AVLNode<Key, Value>* y;
-    AVLNode<Key, Value>* x; 
-    checkImbalance(z, y, x);
-    int imbalance = imbalanceType(z, y, x); 
+/**
+* Constructs an AVLNode in storage taken from the tree's allocator, forwarding
+* the arguments to the item's constructor.
+*/
+template<class Key, class Value, class Alloc>
+template<typename... Args>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::createNode(AVLNode<Key,Value>* parent, Args&&... args)
+{
+    void* mem = this->alloc_.allocate();
+    try {
+        return new (mem) AVLNode<Key, Value>(parent, std::forward<Args>(args)...);
+    }
+    catch (...) {
+        this->alloc_.deallocate(mem);
+        throw;
+    }
+}
+
+/**
+* Destroys an AVLNode and hands its storage back to the tree's allocator.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::destroyNode(Node<Key,Value>* node)
+{
+    static_cast<AVLNode<Key, Value>*>(node)->~AVLNode<Key, Value>();
+    this->alloc_.deallocate(node);
+}
+
+/**
+* Copies a single AVLNode along with its height.
+*/
+template<class Key, class Value, class Alloc>
+Node<Key, Value>* AVLTree<Key, Value, Alloc>::cloneNode(const Node<Key,Value>* src, Node<Key,Value>* parent)
+{
+    AVLNode<Key, Value>* node = createNode(static_cast<AVLNode<Key, Value>*>(parent), src->getItem());
+    node->setHeight(static_cast<const AVLNode<Key, Value>*>(src)->getHeight());
+    node->setSize(static_cast<const AVLNode<Key, Value>*>(src)->getSize());
+    return node;
+}
+
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+{
+    BinarySearchTree<Key, Value, Alloc>::nodeSwap(n1, n2);
+    int tempH = n1->getHeight();
+    n1->setHeight(n2->getHeight());
+    n2->setHeight(tempH);
+    unsigned int tempS = n1->getSize();
+    n1->setSize(n2->getSize());
+    n2->setSize(tempS);
+}
+
+/**
+* Walks up from node after an insert or remove below it, recomputing each
+* height from its children and rotating any node whose children differ by two.
+* Stops at the first subtree whose height came out unchanged, since nothing
+* above it can have changed either. Sizes are adjusted by the caller.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::retrace(AVLNode<Key,Value>* node)
+{
+    while (node != NULL) {
+        int oldHeight = node->getHeight();
+        int lh = nodeHeight(node->getLeft());
+        int rh = nodeHeight(node->getRight());
+        if (abs(lh - rh) > 1) {
+            AVLNode<Key, Value>* y = getTallerChild(node);
+            AVLNode<Key, Value>* x = breakTies(y, node);
+            rotate(node, y, x);
+            // node was pushed down, its parent is now the root of the subtree
+            node = node->getParent();
+        }
+        else {
+            node->setHeight(std::max(lh, rh) + 1);
+        }
+        if (node->getHeight() == oldHeight) return;
+        node = node->getParent();
+    }
+}
+
+/**
+* Applies the rotation matching the shape of z, y and x.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::rotate(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x)
+{
+    int imbalance = imbalanceType(z, y, x);
     if (imbalance == 1) {
         zigzigRight(z, y, x);
     }
@@ -174,118 +561,191 @@ void AVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
     }
 }
 
-template<class Key, class Value>
-void
-AVLTree<Key, Value>::add(const pair<const Key, Value>& keyValuePair)
+/**
+* Returns the number of nodes in the subtree at node, which is 0 for an empty one.
+*/
+template<class Key, class Value, class Alloc>
+std::size_t AVLTree<Key, Value, Alloc>::nodeSize(AVLNode<Key,Value>* node)
+{
+    if (node == NULL) return 0;
+    return node->getSize();
+}
+
+/**
+* Recomputes a node's subtree size from its children.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::updateSize(AVLNode<Key,Value>* node)
 {
-    // TODO
-    if (BinarySearchTree<Key,Value>::root_ == NULL) {
-        BinarySearchTree<Key,Value>::root_ = new AVLNode<Key, Value>(keyValuePair.first, keyValuePair.second, NULL); 
-        return; 
+    node->setSize(static_cast<unsigned int>(nodeSize(node->getLeft()) + nodeSize(node->getRight()) + 1));
+}
+
+/**
+* Adds delta to the subtree size of node and of every ancestor. Unlike heights,
+* sizes change all the way up, so this always walks to the root.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::adjustSizes(AVLNode<Key,Value>* node, int delta)
+{
+    while (node != NULL) {
+        node->setSize(node->getSize() + delta);
+        node = node->getParent();
     }
+}
 
-    // if key already exists 
-    Node<Key, Value>* x = BinarySearchTree<Key,Value>::internalFind(keyValuePair.first);
-    if (x != NULL) {
-        x->setValue(keyValuePair.second); 
+/**
+* Replaces the contents with the key/value pairs in [first, last). When the keys
+* are strictly increasing the tree is built directly in O(n). Otherwise the items
+* are copied out, stably sorted and deduplicated first, keeping the last value
+* given for a key just as a sequence of insert() calls would.
+*/
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Alloc>::assign(ForwardIt first, ForwardIt last)
+{
+    std::size_t n = 0;
+    bool sorted = true;
+    for (ForwardIt prev = first, it = first; it != last; prev = it, ++it, ++n) {
+        if (it != first && !(prev->first < it->first)) sorted = false;
+    }
+    if (sorted) {
+        buildFromSorted(first, n);
         return;
     }
 
-    // find where the node fits  
-    AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key,Value>::root_); 
-    AVLNode<Key, Value>* parent = root; 
-    Key curr = keyValuePair.first;
-    while (root != NULL) {
-        if (root->getKey() > curr) {
-            parent = root; 
-            root = root->getLeft();
-        }
-        else {
-            parent = root; 
-            root = root->getRight(); 
-        }
-    }
-    AVLNode<Key, Value>* node = new AVLNode<Key, Value>(keyValuePair.first, keyValuePair.second, parent);
-    if (parent->getKey() > curr) parent->setLeft(node);
-    else parent->setRight(node);
+    std::vector<std::pair<Key, Value> > items(first, last);
+    std::size_t kept = sortUnique(items);
+    buildFromSorted(std::make_move_iterator(items.begin()), kept);
 }
 
-
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap(AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+/**
+* Stably sorts items by key and moves one item per key to the front, the last
+* one given for that key. Returns how many there are.
+*/
+template<class Key, class Value, class Alloc>
+std::size_t AVLTree<Key, Value, Alloc>::sortUnique(std::vector<std::pair<Key, Value> >& items)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
-    int tempH = n1->getHeight();
-    n1->setHeight(n2->getHeight());
-    n2->setHeight(tempH);
+    std::stable_sort(items.begin(), items.end(),
+        [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return a.first < b.first; });
+    std::size_t kept = 0;
+    for (std::size_t i = 0; i < items.size(); i++) {
+        // a later duplicate overwrites the earlier one
+        if (kept > 0 && !(items[kept - 1].first < items[i].first)) kept--;
+        if (kept != i) items[kept] = std::move(items[i]);
+        kept++;
+    }
+    return kept;
 }
 
-
-template<class Key, class Value>
-void AVLTree<Key, Value>::updateHeights(AVLNode<Key,Value>* newNode)
+/**
+* Replaces the contents with the n items starting at first, whose keys must be
+* strictly increasing.
+*/
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Alloc>::buildFromSorted(ForwardIt first, std::size_t n)
 {
-    // cout << "updating heights" << endl;
-    while (newNode != NULL)
-    {
-        int lh = 0;
-        if (newNode->getLeft() != NULL) lh = newNode->getLeft()->getHeight();
-
-        int rh = 0;
-        if (newNode->getRight() != NULL) rh = newNode->getRight()->getHeight();
-
-        int h = std::max(lh, rh) + 1;
-        newNode->setHeight(h);
-        newNode = newNode->getParent();
-    }
+    this->clearNodes();
+    this->reserve(n);
+    this->root_ = buildRange(first, n);
+    this->size_ = n;
+    this->rethread(this->root_);
 }
 
+/**
+* Builds a perfectly balanced subtree from the next n items, consuming them in
+* order: left half, then the middle item, then the right half. Every node is
+* visited once and the recursion is only O(log n) deep.
+*/
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::buildRange(ForwardIt& it, std::size_t n)
+{
+    if (n == 0) return NULL;
+    std::size_t leftCount = n / 2;
+    AVLNode<Key, Value>* left = buildRange(it, leftCount);
+    AVLNode<Key, Value>* node = createNode(NULL, *it);
+    ++it;
+    AVLNode<Key, Value>* right = buildRange(it, n - leftCount - 1);
+
+    node->setLeft(left);
+    node->setRight(right);
+    if (left != NULL) left->setParent(node);
+    if (right != NULL) right->setParent(node);
+    node->setHeight(std::max(nodeHeight(left), nodeHeight(right)) + 1);
+    node->setSize(static_cast<unsigned int>(n));
+    return node;
+}
 
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::findImbalance(AVLNode<Key,Value>* newNode) 
-{   
-    if (newNode->getParent() == NULL) return newNode; 
+/**
+* Snapshots the tree into a FrozenTree. Later changes to this tree do not
+* show up in the snapshot.
+*/
+template<class Key, class Value, class Alloc>
+FrozenTree<Key, Value> AVLTree<Key, Value, Alloc>::freeze() const
+{
+    return FrozenTree<Key, Value>(this->begin(), this->end());
+}
 
-    while (newNode->getParent() != NULL) {
-        AVLNode<Key, Value>* parent = newNode->getParent();
-        int thisHeight = newNode->getHeight();
-        int otherHeight; 
-        if (parent->getRight() == NULL) otherHeight = 0; 
-        else if (parent->getRight() != newNode) otherHeight = parent->getRight()->getHeight();
-        else if (parent->getLeft() == NULL) otherHeight = 0;
-        else if (parent->getLeft() != newNode) otherHeight = parent->getLeft()->getHeight(); 
-        if (abs(thisHeight - otherHeight) > 1) return parent; 
-        newNode = newNode->getParent(); 
+/**
+* Returns an iterator to the k-th smallest item (counting from 0), or the end
+* iterator if k is not less than size().
+*/
+template<class Key, class Value, class Alloc>
+typename AVLTree<Key, Value, Alloc>::iterator
+AVLTree<Key, Value, Alloc>::select(std::size_t k) const
+{
+    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while (curr != NULL) {
+        std::size_t leftSize = nodeSize(curr->getLeft());
+        if (k < leftSize) {
+            curr = curr->getLeft();
+        }
+        else if (k == leftSize) {
+            break;
+        }
+        else {
+            k -= leftSize + 1;
+            curr = curr->getRight();
+        }
     }
-    return 0; 
+    return this->makeIterator(curr);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::checkImbalance(AVLNode<Key,Value>*& z, AVLNode<Key,Value>*&y, AVLNode<Key,Value>*&x) 
+/**
+* Returns the number of keys strictly less than key, which is also the index
+* select() would take to reach key if it is present.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+std::size_t AVLTree<Key, Value, Alloc>::rank(const K& key) const
 {
-    // cout << "calculating y and x" << endl;
-    AVLNode<Key,Value>* left = z->getLeft();
-    AVLNode<Key,Value>* right = z->getRight();
-    // finding y - child with greatest height 
-    if (left != NULL && right != NULL) {
-        if (left->getHeight() > right->getHeight()) y = left; 
-        else y = right;
+    std::size_t count = 0;
+    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_);
+    while (curr != NULL) {
+        if (curr->getKey() < key) {
+            count += nodeSize(curr->getLeft()) + 1;
+            curr = curr->getRight();
+        }
+        else {
+            curr = curr->getLeft();
+        }
     }
-    else if (left != NULL && right == NULL) y = left; 
-    else if (left == NULL && right != NULL) y = right; 
+    return count;
+}
 
-    AVLNode<Key,Value>* gleft = y->getLeft(); 
-    AVLNode<Key,Value>* gright = y->getRight();
-    // finding x - grandchild with greatest height 
-    if (gleft != NULL && gright != NULL) {
-        if (gleft->getHeight() > gright->getHeight()) x = gleft; 
-        else x = gright;
-    }
-    else if (gleft != NULL && gright == NULL) x = gleft; 
-    else if (gleft == NULL && gright != NULL) x = gright; 
+/**
+* Returns the stored height of a node, where an empty subtree has height 0.
+*/
+template<class Key, class Value, class Alloc>
+int AVLTree<Key, Value, Alloc>::nodeHeight(AVLNode<Key,Value>* node)
+{
+    if (node == NULL) return 0;
+    return node->getHeight();
 }
 
-template<class Key, class Value>
-int AVLTree<Key, Value>::imbalanceType(AVLNode<Key,Value>*& z, AVLNode<Key,Value>*& y, AVLNode<Key,Value>*& x) 
+template<class Key, class Value, class Alloc>
+int AVLTree<Key, Value, Alloc>::imbalanceType(AVLNode<Key,Value>*& z, AVLNode<Key,Value>*& y, AVLNode<Key,Value>*& x) 
 {
     int type = 0;  
 
@@ -308,8 +768,8 @@ int AVLTree<Key, Value>::imbalanceType(AVLNode<Key,Value>*& z, AVLNode<Key,Value
     return type; 
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::zigzigRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x) 
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::zigzigRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x) 
 {
     y->setParent(z->getParent()); 
     // if z has a parent, update it 
@@ -318,7 +778,7 @@ void AVLTree<Key, Value>::zigzigRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
         else z->getParent()->setRight(y);
     } 
     // if z is the root
-    else BinarySearchTree<Key,Value>::root_ = y;
+    else BinarySearchTree<Key,Value,Alloc>::root_ = y;
 
     z->setParent(y);
     AVLNode<Key,Value>* left = y->getLeft();
@@ -326,8 +786,6 @@ void AVLTree<Key, Value>::zigzigRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
     if (left != nullptr) left->setParent(z);
     y->setLeft(z);
 
-    //changeHeights(z, y); 
- 
     int zh = 1;
     if (getTallerChild(z) != NULL) {
         zh = getTallerChild(z)->getHeight() + 1;
@@ -336,21 +794,12 @@ void AVLTree<Key, Value>::zigzigRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
     z->setHeight(zh);
     int yh = getTallerChild(y)->getHeight() + 1;
     y->setHeight(yh);
+    updateSize(z);
+    updateSize(y);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::changeHeights(AVLNode<Key,Value>*z, AVLNode<Key,Value>*y) 
-{
-    int zh = 1;
-    if (getTallerChild(z) != NULL) zh = getTallerChild(z)->getHeight() + 1;
-    // cout << "changing height" << endl;
-    z->setHeight(zh);
-    int yh = getTallerChild(y)->getHeight() + 1;
-    y->setHeight(yh);
-}
-
-template<class Key, class Value>
-void AVLTree<Key, Value>::zigzigLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x) 
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::zigzigLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x) 
 {
     // cout << "zigzig left" << endl; 
     y->setParent(z->getParent()); 
@@ -360,7 +809,7 @@ void AVLTree<Key, Value>::zigzigLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
         else z->getParent()->setLeft(y);
     } 
     // if z is the root
-    else BinarySearchTree<Key,Value>::root_ = y;
+    else BinarySearchTree<Key,Value,Alloc>::root_ = y;
 
     z->setParent(y);
     AVLNode<Key,Value>* right = y->getRight();
@@ -368,21 +817,22 @@ void AVLTree<Key, Value>::zigzigLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
     if (right != nullptr) right->setParent(z);
     y->setRight(z);
 
-    //changeHeights(z, y);
     int zh = 1;
     if (getTallerChild(z) != NULL) zh = getTallerChild(z)->getHeight() + 1;
     z->setHeight(zh);
     int yh = getTallerChild(y)->getHeight() + 1;
     y->setHeight(yh);
+    updateSize(z);
+    updateSize(y);
     // int zh = z->getHeight()-2; 
     // z->setHeight(zh);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::zigzagLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x)
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::zigzagLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x)
 {
     // cout << "zigzag left" << endl;
-    if (z == BinarySearchTree<Key,Value>::root_) BinarySearchTree<Key,Value>::root_ = x;
+    if (z == BinarySearchTree<Key,Value,Alloc>::root_) BinarySearchTree<Key,Value,Alloc>::root_ = x;
 
 
     x->setParent(z->getParent());
@@ -406,7 +856,6 @@ void AVLTree<Key, Value>::zigzagLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
     int yh = 1;
     if (getTallerChild(y) != NULL) yh = getTallerChild(y)->getHeight() + 1;
     y->setHeight(yh);
-    //changeHeights(z, y);
 
     x->setLeft(z);
     x->setRight(y);
@@ -418,12 +867,15 @@ void AVLTree<Key, Value>::zigzagLeft(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
     y->setParent(x);
     int xh = std::max(z->getHeight(), y->getHeight()) + 1;
     x->setHeight(xh);
+    updateSize(z);
+    updateSize(y);
+    updateSize(x);
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::zigzagRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x)
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::zigzagRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>* y, AVLNode<Key,Value>* x)
 {
-    if (z == BinarySearchTree<Key,Value>::root_) BinarySearchTree<Key,Value>::root_ = x;
+    if (z == BinarySearchTree<Key,Value,Alloc>::root_) BinarySearchTree<Key,Value,Alloc>::root_ = x;
 
     AVLNode<Key,Value>* parent = z->getParent(); 
     x->setParent(parent);
@@ -447,7 +899,6 @@ void AVLTree<Key, Value>::zigzagRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
     int yh = 1;
     if (getTallerChild(y)) yh = getTallerChild(y)->getHeight() + 1;
     y->setHeight(yh);
-    //changeHeights(z, y);
 
     x->setLeft(y);
     x->setRight(z);
@@ -459,119 +910,49 @@ void AVLTree<Key, Value>::zigzagRight(AVLNode<Key,Value>* z, AVLNode<Key,Value>*
     y->setParent(x);
     int xh = std::max(z->getHeight(), y->getHeight()) + 1;
     x->setHeight(xh);
+    updateSize(z);
+    updateSize(y);
+    updateSize(x);
 }
 
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key)
+/**
+* Removes the key, then retraces from the parent of the node that was physically
+* unlinked. Each step is O(1) using the stored heights, so the whole removal,
+* including any cascade of rotations, is O(log n).
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::remove(const Key& key)
 {
-    // cout << "removing " << key << endl; 
-    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key,Value>::internalFind(key));
-    AVLNode<Key, Value>* succ;
+    AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key,Value,Alloc>::internalFind(key));
 
     // if the node doesn't exist 
     if (node == NULL) return;
 
-    AVLNode<Key,Value>* left = node->getLeft();
-    AVLNode<Key,Value>* right = node->getRight(); 
-    // if it has two children 
-    if (left != NULL && right != NULL) {   
-        succ = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key,Value>::successor(node));
+    // if it has two children, trade places with the successor, which has at most one child
+    if (node->getLeft() != NULL && node->getRight() != NULL) {
+        AVLNode<Key, Value>* succ = static_cast<AVLNode<Key, Value>*>(BinarySearchTree<Key,Value,Alloc>::successor(node));
         nodeSwap(node, succ);
-        if (node->getRight() != NULL) {
-            nodeSwap(node, node->getRight());
-            node->getParent()->setRight(NULL); 
-        }
-        else if (node->getParent() == succ) succ->setRight(NULL);
-        else node->getParent()->setLeft(NULL); 
-        updateHeights(succ);
-        delete node;
-    }
-
-    // if it only has a left child 
-    else if (left != NULL) {
-        succ = left;
-        if (node == BinarySearchTree<Key,Value>::root_) {
-            BinarySearchTree<Key,Value>::root_ = succ;
-            succ->setParent(NULL); 
-        }
-        else if (node->getParent()->getLeft() == node){
-            succ->setParent(node->getParent());
-            node->getParent()->setLeft(succ);
-        }
-        else {
-            succ->setParent(node->getParent());
-            node->getParent()->setRight(succ);
-        }
-        updateHeights(succ);
-        delete node;
-    }
-
-    // if it only has a right child 
-    else if (right != NULL) {
-        succ = node->getRight();
-        if (node == BinarySearchTree<Key,Value>::root_) {
-            BinarySearchTree<Key,Value>::root_ = succ;
-            succ->setParent(NULL);
-        }
-        else if (node->getParent()->getLeft() == node) {
-            succ->setParent(node->getParent());
-            node->getParent()->setLeft(succ);
-        }
-        else {
-            succ->setParent(node->getParent());
-            node->getParent()->setRight(succ);
-        }
-        updateHeights(succ);
-        delete node;
-    }
-    
-    // if it is the root 
-    else if (node == BinarySearchTree<Key,Value>::root_)
-    {
-        BinarySearchTree<Key,Value>::root_ = nullptr;
-        delete node;
     }
 
-    // if it is a leaf node 
-    else {
-        // cout << "no children" << endl;
-        succ = node->getParent();
-        if (succ->getLeft() == node) succ->setLeft(NULL);
-        else succ->setRight(NULL);
-        updateHeights(succ);
-        delete node;
-    }
-
-    while (this->isBalanced() == false)
-    {
-        AVLNode<Key, Value>* z = findImbalance(succ);
-        // cout << z << endl;
-        // cout << "test" << endl;
-        AVLNode<Key, Value>* y = getTallerChild(z);
-        AVLNode<Key, Value>* x = breakTies(y, z);
-        int imbalance = imbalanceType(z, y, x);
-        if (imbalance == 1) {
-            zigzigRight(z, y, x);
-            // cout << "z" << z->getKey() << " new height " << z->getHeight() << endl;
-        }
-        else if (imbalance == 2) {
-            zigzigLeft(z, y, x); 
-            // cout << "z" << z->getKey() << " new height " << z->getHeight() << endl;
-        }
-        else if (imbalance == 3) {
-            zigzagLeft(z, y, x);
-            // cout << "z" << z->getKey() << " new height " << z->getHeight() << endl;
-        }
-        else {
-            zigzagRight(z,y,x);
-            // cout << "z" << z->getKey() << " new height " << z->getHeight() << endl;
-        }
-    }
+    // splice the node out, promoting its only child (if any)
+    AVLNode<Key, Value>* child = node->getLeft();
+    if (child == NULL) child = node->getRight();
+    AVLNode<Key, Value>* parent = node->getParent();
+    if (child != NULL) child->setParent(parent);
+    if (parent == NULL) BinarySearchTree<Key,Value,Alloc>::root_ = child;
+    else if (parent->getLeft() == node) parent->setLeft(child);
+    else parent->setRight(child);
+    this->threadRemove(node);
+    destroyNode(node);
+    adjustSizes(parent, -1);
+    this->size_--;
+
+    retrace(parent);
 }
 
-template<class Key, class Value>
-AVLNode<Key,Value>* AVLTree<Key, Value>::breakTies(AVLNode<Key,Value>* y, AVLNode<Key,Value>* z)
+template<class Key, class Value, class Alloc>
+AVLNode<Key,Value>* AVLTree<Key, Value, Alloc>::breakTies(AVLNode<Key,Value>* y, AVLNode<Key,Value>* z)
 {
     AVLNode<Key,Value>* left = y->getLeft(); 
     AVLNode<Key,Value>* right = y->getRight(); 
@@ -587,8 +968,8 @@ AVLNode<Key,Value>* AVLTree<Key, Value>::breakTies(AVLNode<Key,Value>* y, AVLNod
     }
 }
 
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::getTallerChild(AVLNode<Key,Value>* currNode) 
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::getTallerChild(AVLNode<Key,Value>* currNode) 
 {   
     // cout << "getting taller child of " << currNode->getKey() << endl;
     if (currNode->getLeft() == NULL) return currNode->getRight();
@@ -599,4 +980,480 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::getTallerChild(AVLNode<Key,Value>* cur
     }
 }
 
+/*
+  ---------------------------------------------------------------
+  Join-based bulk operations. These work on detached subtrees whose
+  nodes all live in this tree's allocator: a returned subtree root has
+  an unspecified parent, which the caller is responsible for setting.
+  ---------------------------------------------------------------
+*/
+
+/**
+* Makes node the root of the subtree (left, node, right) and recomputes its height
+* and size. The caller guarantees the heights of left and right differ by at most 1.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::makeNode(AVLNode<Key,Value>* left, AVLNode<Key,Value>* node, AVLNode<Key,Value>* right)
+{
+    node->setLeft(left);
+    node->setRight(right);
+    if (left != NULL) left->setParent(node);
+    if (right != NULL) right->setParent(node);
+    node->setHeight(std::max(nodeHeight(left), nodeHeight(right)) + 1);
+    updateSize(node);
+    return node;
+}
+
+/**
+* Single rotations on a detached subtree, returning its new root.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::rotateLeftSub(AVLNode<Key,Value>* node)
+{
+    AVLNode<Key, Value>* right = node->getRight();
+    return makeNode(makeNode(node->getLeft(), node, right->getLeft()), right, right->getRight());
+}
+
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::rotateRightSub(AVLNode<Key,Value>* node)
+{
+    AVLNode<Key, Value>* left = node->getLeft();
+    return makeNode(left->getLeft(), left, makeNode(left->getRight(), node, node->getRight()));
+}
+
+/**
+* Join when left is the taller side: walk down left's right spine until the heights
+* are close enough to hang (c, middle, right) there, then rebalance on the way up.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::joinRight(AVLNode<Key,Value>* left, AVLNode<Key,Value>* middle, AVLNode<Key,Value>* right)
+{
+    AVLNode<Key, Value>* ll = left->getLeft();
+    AVLNode<Key, Value>* c = left->getRight();
+    if (nodeHeight(c) <= nodeHeight(right) + 1) {
+        AVLNode<Key, Value>* t = makeNode(c, middle, right);
+        if (nodeHeight(t) <= nodeHeight(ll) + 1) return makeNode(ll, left, t);
+        return rotateLeftSub(makeNode(ll, left, rotateRightSub(t)));
+    }
+    AVLNode<Key, Value>* t = joinRight(c, middle, right);
+    AVLNode<Key, Value>* joined = makeNode(ll, left, t);
+    if (nodeHeight(t) <= nodeHeight(ll) + 1) return joined;
+    return rotateLeftSub(joined);
+}
+
+/**
+* Mirror image of joinRight() for when right is the taller side.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::joinLeft(AVLNode<Key,Value>* left, AVLNode<Key,Value>* middle, AVLNode<Key,Value>* right)
+{
+    AVLNode<Key, Value>* rr = right->getRight();
+    AVLNode<Key, Value>* c = right->getLeft();
+    if (nodeHeight(c) <= nodeHeight(left) + 1) {
+        AVLNode<Key, Value>* t = makeNode(left, middle, c);
+        if (nodeHeight(t) <= nodeHeight(rr) + 1) return makeNode(t, right, rr);
+        return rotateRightSub(makeNode(rotateLeftSub(t), right, rr));
+    }
+    AVLNode<Key, Value>* t = joinLeft(left, middle, c);
+    AVLNode<Key, Value>* joined = makeNode(t, right, rr);
+    if (nodeHeight(t) <= nodeHeight(rr) + 1) return joined;
+    return rotateRightSub(joined);
+}
+
+/**
+* Joins two AVL subtrees with a middle node whose key lies strictly between them.
+* O(|h(left) - h(right)| + 1).
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::join(AVLNode<Key,Value>* left, AVLNode<Key,Value>* middle, AVLNode<Key,Value>* right)
+{
+    if (nodeHeight(left) > nodeHeight(right) + 1) return joinRight(left, middle, right);
+    if (nodeHeight(right) > nodeHeight(left) + 1) return joinLeft(left, middle, right);
+    return makeNode(left, middle, right);
+}
+
+/**
+* Joins two subtrees where every key of left is less than every key of right,
+* using the largest node of left as the middle.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::join2(AVLNode<Key,Value>* left, AVLNode<Key,Value>* right)
+{
+    if (left == NULL) return right;
+    AVLNode<Key, Value>* last;
+    AVLNode<Key, Value>* rest = splitLast(left, last);
+    return join(rest, last, right);
+}
+
+/**
+* Detaches the largest node of the subtree, returning what is left of the subtree.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::splitLast(AVLNode<Key,Value>* node, AVLNode<Key,Value>*& last)
+{
+    if (node->getRight() == NULL) {
+        last = node;
+        AVLNode<Key, Value>* left = node->getLeft();
+        node->setLeft(NULL);
+        return left;
+    }
+    AVLNode<Key, Value>* rest = splitLast(node->getRight(), last);
+    return join(node->getLeft(), node, rest);
+}
+
+/**
+* Splits the subtree into the keys less than key (left) and greater than key
+* (right). Returns the detached node holding key itself, or NULL. O(log n).
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::split(AVLNode<Key,Value>* node, const K& key, AVLNode<Key,Value>*& left, AVLNode<Key,Value>*& right)
+{
+    if (node == NULL) {
+        left = NULL;
+        right = NULL;
+        return NULL;
+    }
+    AVLNode<Key, Value>* l = node->getLeft();
+    AVLNode<Key, Value>* r = node->getRight();
+    if (key < node->getKey()) {
+        AVLNode<Key, Value>* upper;
+        AVLNode<Key, Value>* found = split(l, key, left, upper);
+        right = join(upper, node, r);
+        return found;
+    }
+    if (node->getKey() < key) {
+        AVLNode<Key, Value>* lower;
+        AVLNode<Key, Value>* found = split(r, key, lower, right);
+        left = join(l, node, lower);
+        return found;
+    }
+    left = l;
+    right = r;
+    node->setLeft(NULL);
+    node->setRight(NULL);
+    return node;
+}
+
+/**
+* How many more levels of the fork-join recursion may start a thread: about
+* log2 of the hardware threads, so no more tasks run at once than there are
+* threads to run them, but at least one level when parallel is set and none
+* otherwise. Each level that forks passes one less down; at 0 the recursion
+* carries on serially.
+*/
+template<class Key, class Value, class Alloc>
+int AVLTree<Key, Value, Alloc>::forkDepth(bool parallel)
+{
+    if (!parallel) return 0;
+    unsigned int threads = std::thread::hardware_concurrency();
+    int depth = 1;
+    while (depth < 16 && (1u << depth) < threads) depth++;
+    return depth;
+}
+
+/**
+* The union of two subtrees. Where both hold a key, t1's node is kept and t2's
+* is dropped. O(m log(n/m + 1)) work for sizes m <= n.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::unionNodes(AVLNode<Key,Value>* t1, AVLNode<Key,Value>* t2, std::vector<AVLNode<Key,Value>*>& dropped, int forks)
+{
+    if (t1 == NULL) return t2;
+    if (t2 == NULL) return t1;
+    AVLNode<Key, Value>* l2;
+    AVLNode<Key, Value>* r2;
+    AVLNode<Key, Value>* dup = split(t2, t1->getKey(), l2, r2);
+    if (dup != NULL) dropped.push_back(dup);
+
+    AVLNode<Key, Value>* l1 = t1->getLeft();
+    AVLNode<Key, Value>* r1 = t1->getRight();
+    AVLNode<Key, Value>* left;
+    AVLNode<Key, Value>* right;
+    if (forks > 0 && nodeSize(l1) + nodeSize(l2) >= parallelCutoff) {
+        std::vector<AVLNode<Key, Value>*> leftDropped;
+        std::future<AVLNode<Key, Value>*> task = std::async(std::launch::async,
+            [&]() { return unionNodes(l1, l2, leftDropped, forks - 1); });
+        right = unionNodes(r1, r2, dropped, forks - 1);
+        left = task.get();
+        dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+    }
+    else {
+        left = unionNodes(l1, l2, dropped, forks);
+        right = unionNodes(r1, r2, dropped, forks);
+    }
+    return join(left, t1, right);
+}
+
+/**
+* The intersection of two subtrees, keeping t1's nodes. Everything else is dropped.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::intersectNodes(AVLNode<Key,Value>* t1, AVLNode<Key,Value>* t2, std::vector<AVLNode<Key,Value>*>& dropped, int forks)
+{
+    if (t1 == NULL || t2 == NULL) {
+        if (t1 != NULL) dropped.push_back(t1);
+        if (t2 != NULL) dropped.push_back(t2);
+        return NULL;
+    }
+    AVLNode<Key, Value>* l2;
+    AVLNode<Key, Value>* r2;
+    AVLNode<Key, Value>* match = split(t2, t1->getKey(), l2, r2);
+
+    AVLNode<Key, Value>* l1 = t1->getLeft();
+    AVLNode<Key, Value>* r1 = t1->getRight();
+    t1->setLeft(NULL);
+    t1->setRight(NULL);
+    AVLNode<Key, Value>* left;
+    AVLNode<Key, Value>* right;
+    if (forks > 0 && nodeSize(l1) + nodeSize(l2) >= parallelCutoff) {
+        std::vector<AVLNode<Key, Value>*> leftDropped;
+        std::future<AVLNode<Key, Value>*> task = std::async(std::launch::async,
+            [&]() { return intersectNodes(l1, l2, leftDropped, forks - 1); });
+        right = intersectNodes(r1, r2, dropped, forks - 1);
+        left = task.get();
+        dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+    }
+    else {
+        left = intersectNodes(l1, l2, dropped, forks);
+        right = intersectNodes(r1, r2, dropped, forks);
+    }
+    if (match != NULL) {
+        dropped.push_back(match);
+        return join(left, t1, right);
+    }
+    dropped.push_back(t1);
+    return join2(left, right);
+}
+
+/**
+* The keys of t1 that are not in t2. Splits t1 around each node of t2, so the
+* nodes of t2 and the matching nodes of t1 are dropped.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::differenceNodes(AVLNode<Key,Value>* t1, AVLNode<Key,Value>* t2, std::vector<AVLNode<Key,Value>*>& dropped, int forks)
+{
+    if (t1 == NULL || t2 == NULL) {
+        if (t2 != NULL) dropped.push_back(t2);
+        return t1;
+    }
+    AVLNode<Key, Value>* l1;
+    AVLNode<Key, Value>* r1;
+    AVLNode<Key, Value>* match = split(t1, t2->getKey(), l1, r1);
+    if (match != NULL) dropped.push_back(match);
+
+    AVLNode<Key, Value>* l2 = t2->getLeft();
+    AVLNode<Key, Value>* r2 = t2->getRight();
+    t2->setLeft(NULL);
+    t2->setRight(NULL);
+    dropped.push_back(t2);
+    AVLNode<Key, Value>* left;
+    AVLNode<Key, Value>* right;
+    if (forks > 0 && nodeSize(l1) + nodeSize(l2) >= parallelCutoff) {
+        std::vector<AVLNode<Key, Value>*> leftDropped;
+        std::future<AVLNode<Key, Value>*> task = std::async(std::launch::async,
+            [&]() { return differenceNodes(l1, l2, leftDropped, forks - 1); });
+        right = differenceNodes(r1, r2, dropped, forks - 1);
+        left = task.get();
+        dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+    }
+    else {
+        left = differenceNodes(l1, l2, dropped, forks);
+        right = differenceNodes(r1, r2, dropped, forks);
+    }
+    return join2(left, right);
+}
+
+/**
+* The keys of t that are not among the n sorted, distinct keys. This is
+* differenceNodes with the keys standing in for t2 as an implicit balanced tree
+* rooted at the middle key, so no nodes are built for them.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::differenceKeys(AVLNode<Key,Value>* t, const Key* keys, std::size_t n, std::vector<AVLNode<Key,Value>*>& dropped, int forks)
+{
+    if (t == NULL || n == 0) return t;
+    std::size_t mid = n / 2;
+    AVLNode<Key, Value>* l;
+    AVLNode<Key, Value>* r;
+    AVLNode<Key, Value>* match = split(t, keys[mid], l, r);
+    if (match != NULL) dropped.push_back(match);
+
+    AVLNode<Key, Value>* left;
+    AVLNode<Key, Value>* right;
+    if (forks > 0 && nodeSize(l) + mid >= parallelCutoff) {
+        std::vector<AVLNode<Key, Value>*> leftDropped;
+        std::future<AVLNode<Key, Value>*> task = std::async(std::launch::async,
+            [&]() { return differenceKeys(l, keys, mid, leftDropped, forks - 1); });
+        right = differenceKeys(r, keys + mid + 1, n - mid - 1, dropped, forks - 1);
+        left = task.get();
+        dropped.insert(dropped.end(), leftDropped.begin(), leftDropped.end());
+    }
+    else {
+        left = differenceKeys(l, keys, mid, dropped, forks);
+        right = differenceKeys(r, keys + mid + 1, n - mid - 1, dropped, forks);
+    }
+    return join2(left, right);
+}
+
+/**
+* Installs a subtree produced by the bulk operations as the whole tree and frees
+* the subtrees they dropped. Under BST_THREADED the threads are rebuilt with an
+* O(n) in-order walk: a merge can interleave the two inputs anywhere, so unlike
+* erase(lo, hi) there is no short list of seams to patch.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::setRoot(AVLNode<Key,Value>* root, std::vector<AVLNode<Key,Value>*>& dropped)
+{
+    if (root != NULL) root->setParent(NULL);
+    this->root_ = root;
+    this->size_ = nodeSize(root);
+    for (std::size_t i = 0; i < dropped.size(); i++) {
+        this->clearer(dropped[i]);
+    }
+    this->rethread(root);
+}
+
+/**
+* Copies other's nodes into this tree's allocator so the bulk operations can take
+* them apart and reuse them. The caller owns the returned subtree.
+*/
+template<class Key, class Value, class Alloc>
+AVLNode<Key, Value>* AVLTree<Key, Value, Alloc>::borrow(const AVLTree<Key, Value, Alloc>& other)
+{
+    AVLNode<Key, Value>* copy = static_cast<AVLNode<Key, Value>*>(this->cloneTree(other.root_));
+    return copy;
+}
+
+/**
+* Adds every key of other that is not already here. Existing values are kept.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::unionWith(const AVLTree<Key, Value, Alloc>& other, bool parallel)
+{
+    if (this == &other) return;
+    std::vector<AVLNode<Key, Value>*> dropped;
+    AVLNode<Key, Value>* root = unionNodes(static_cast<AVLNode<Key, Value>*>(this->root_), borrow(other), dropped, forkDepth(parallel));
+    setRoot(root, dropped);
+}
+
+/**
+* Removes every key that is not also in other.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::intersectWith(const AVLTree<Key, Value, Alloc>& other, bool parallel)
+{
+    if (this == &other) return;
+    std::vector<AVLNode<Key, Value>*> dropped;
+    AVLNode<Key, Value>* root = intersectNodes(static_cast<AVLNode<Key, Value>*>(this->root_), borrow(other), dropped, forkDepth(parallel));
+    setRoot(root, dropped);
+}
+
+/**
+* Removes every key that is in other.
+*/
+template<class Key, class Value, class Alloc>
+void AVLTree<Key, Value, Alloc>::differenceWith(const AVLTree<Key, Value, Alloc>& other, bool parallel)
+{
+    if (this == &other) {
+        this->clear();
+        return;
+    }
+    std::vector<AVLNode<Key, Value>*> dropped;
+    AVLNode<Key, Value>* root = differenceNodes(static_cast<AVLNode<Key, Value>*>(this->root_), borrow(other), dropped, forkDepth(parallel));
+    setRoot(root, dropped);
+}
+
+/**
+* Inserts the key/value pairs in [first, last), overwriting the values of keys
+* already present; among repeats within the batch the last one wins. The batch
+* is sorted and built into a balanced subtree in O(m log m), then united with
+* the tree in O(m log(n/m + 1)), with the batch's nodes kept where keys meet.
+* A batch that is tiny next to the tree is instead inserted key by key in
+* sorted order, where consecutive descents share their cached upper levels and
+* beat the splits and joins.
+*/
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Alloc>::insertBatch(ForwardIt first, ForwardIt last, bool parallel)
+{
+    std::vector<std::pair<Key, Value> > items(first, last);
+    std::size_t kept = sortUnique(items);
+    if (kept * smallBatchRatio < this->size_) {
+        for (std::size_t i = 0; i < kept; i++) {
+            insert_or_assign(std::move(items[i].first), std::move(items[i].second));
+        }
+        return;
+    }
+    std::move_iterator<typename std::vector<std::pair<Key, Value> >::iterator> it(items.begin());
+    AVLNode<Key, Value>* batch = buildRange(it, kept);
+
+    std::vector<AVLNode<Key, Value>*> dropped;
+    AVLNode<Key, Value>* root = unionNodes(batch, static_cast<AVLNode<Key, Value>*>(this->root_), dropped, forkDepth(parallel));
+    setRoot(root, dropped);
+}
+
+/**
+* Removes the keys in [first, last), ignoring any that are not present. The keys
+* are sorted and then split out of the tree with one difference pass, or, for a
+* tiny batch, removed one by one in sorted order.
+*/
+template<class Key, class Value, class Alloc>
+template<typename ForwardIt>
+void AVLTree<Key, Value, Alloc>::removeBatch(ForwardIt first, ForwardIt last, bool parallel)
+{
+    std::vector<Key> keys(first, last);
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end(),
+        [](const Key& a, const Key& b) { return !(a < b); }), keys.end());
+    if (keys.size() * smallBatchRatio < this->size_) {
+        for (std::size_t i = 0; i < keys.size(); i++) {
+            remove(keys[i]);
+        }
+        return;
+    }
+
+    std::vector<AVLNode<Key, Value>*> dropped;
+    AVLNode<Key, Value>* root = differenceKeys(static_cast<AVLNode<Key, Value>*>(this->root_), keys.data(), keys.size(), dropped, forkDepth(parallel));
+    setRoot(root, dropped);
+}
+
+/**
+* Removes every item with lo <= key < hi and returns how many there were. The
+* tree is split at lo and at hi, the middle piece is freed and the outer pieces
+* are joined back together, so the rebalancing is O(log n) however many items go,
+* on top of O(number removed) to free them.
+*/
+template<class Key, class Value, class Alloc>
+std::size_t AVLTree<Key, Value, Alloc>::erase(const Key& lo, const Key& hi)
+{
+    if (!(lo < hi)) return 0;
+#ifdef BST_THREADED
+    // the neighbours either side of the cut, which end up next to each other
+    Node<Key, Value>* after = this->lowerBoundNode(hi, KeyLess());
+    Node<Key, Value>* before = this->lowerBoundNode(lo, KeyLess());
+    before = before != NULL ? before->getPrev() : this->getLargestNode();
+#endif
+    AVLNode<Key, Value>* left;
+    AVLNode<Key, Value>* rest;
+    AVLNode<Key, Value>* middle;
+    AVLNode<Key, Value>* right;
+    AVLNode<Key, Value>* first = split(static_cast<AVLNode<Key, Value>*>(this->root_), lo, left, rest);
+    AVLNode<Key, Value>* last = split(rest, hi, middle, right);
+    // the node for lo goes with the items being removed, the one for hi stays
+    if (first != NULL) middle = join(NULL, first, middle);
+    if (last != NULL) right = join(NULL, last, right);
+
+    std::size_t erased = nodeSize(middle);
+    this->clearer(middle);
+    AVLNode<Key, Value>* root = join2(left, right);
+    if (root != NULL) root->setParent(NULL);
+    this->root_ = root;
+    this->size_ -= erased;
+#ifdef BST_THREADED
+    this->threadJoin(before, after);
+#endif
+    return erased;
+}
+
 #endif
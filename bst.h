@@ -4,22 +4,37 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cstddef>
+#include <iterator>
 #include <utility>
+#include <tuple>
+#include <type_traits>
+#include "node_alloc.h"
 using namespace std; 
 
 /**
  * A templated class for a Node in a search tree.
- * The getters for parent/left/right are virtual so
- * that they can be overridden for future kinds of
- * search trees, such as Red Black trees, Splay trees,
- * and AVL trees.
+ * Nothing here is virtual, so a node carries no vtable
+ * pointer and every traversal step is an inlined load.
+ * Derived nodes, such as the AVLNode, hide the getters
+ * for parent/left/right with versions that return their
+ * own type, and the tree that owns them always knows the
+ * exact node type it allocated.
+ *
+ * Defining BST_THREADED before including this header
+ * threads the nodes of every tree into a sorted doubly
+ * linked list (next/prev), which the trees keep up to
+ * date, so that iterating costs one pointer hop per item
+ * instead of climbing parent links. It must be defined
+ * the same way in every file of a program.
  */
 template <typename Key, typename Value>
 class Node
 {
 public:
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
-    virtual ~Node();
+    template<typename... Args> Node(Node<Key, Value>* parent, Args&&... args);
+    ~Node();
 
     const std::pair<const Key, Value>& getItem() const;
     std::pair<const Key, Value>& getItem();
@@ -27,20 +42,33 @@ public:
     const Value& getValue() const;
     Value& getValue();
 
-    virtual Node<Key, Value>* getParent() const;
-    virtual Node<Key, Value>* getLeft() const;
-    virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getParent() const;
+    Node<Key, Value>* getLeft() const;
+    Node<Key, Value>* getRight() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
 
+#ifdef BST_THREADED
+    Node<Key, Value>* getNext() const;
+    Node<Key, Value>* getPrev() const;
+    void setNext(Node<Key, Value>* next);
+    void setPrev(Node<Key, Value>* prev);
+#endif
+
 protected:
-    std::pair<const Key, Value> item_;
+    // links first so they share a cache line no matter how large the item is
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
+    std::pair<const Key, Value> item_;
+#ifdef BST_THREADED
+    // in-order neighbours, after the item since only iteration reads them
+    Node<Key, Value>* next_;
+    Node<Key, Value>* prev_;
+#endif
 };
 
 /*
@@ -54,13 +82,34 @@ protected:
 */
 template<typename Key, typename Value>
 Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* parent) :
-    item_(key, value),
     parent_(parent),
     left_(NULL),
-    right_(NULL) 
+    right_(NULL),
+    item_(key, value)
+#ifdef BST_THREADED
+    , next_(NULL), prev_(NULL)
+#endif
 {
 
 
+}
+
+/**
+* A constructor that builds the item in place from the given arguments, exactly
+* as std::pair's constructors would (including std::piecewise_construct).
+*/
+template<typename Key, typename Value>
+template<typename... Args>
+Node<Key, Value>::Node(Node<Key, Value>* parent, Args&&... args) :
+    parent_(parent),
+    left_(NULL),
+    right_(NULL),
+    item_(std::forward<Args>(args)...)
+#ifdef BST_THREADED
+    , next_(NULL), prev_(NULL)
+#endif
+{
+
 }
 
 /**
@@ -120,7 +169,7 @@ Value& Node<Key, Value>::getValue()
 }
 
 /**
-* An implementation of the virtual function for retreiving the parent.
+* A getter for the parent.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getParent() const
@@ -129,7 +178,7 @@ Node<Key, Value>* Node<Key, Value>::getParent() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the left child.
+* A getter for the left child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getLeft() const
@@ -138,7 +187,7 @@ Node<Key, Value>* Node<Key, Value>::getLeft() const
 }
 
 /**
-* An implementation of the virtual function for retreiving the right child.
+* A getter for the right child.
 */
 template<typename Key, typename Value>
 Node<Key, Value>* Node<Key, Value>::getRight() const
@@ -182,34 +231,126 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+#ifdef BST_THREADED
+/**
+* Getters and setters for the in-order neighbours of a threaded node.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::getNext() const
+{
+    return next_;
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::getPrev() const
+{
+    return prev_;
+}
+
+template<typename Key, typename Value>
+void Node<Key, Value>::setNext(Node<Key, Value>* next)
+{
+    next_ = next;
+}
+
+template<typename Key, typename Value>
+void Node<Key, Value>::setPrev(Node<Key, Value>* prev)
+{
+    prev_ = prev;
+}
+#endif
+
 /*
   ---------------------------------------
   End implementations for the Node class.
   ---------------------------------------
 */
 
+/**
+* Hints the cache to start loading a node we are likely to visit next.
+*/
+#if defined(__GNUC__)
+#define BST_PREFETCH(ptr) __builtin_prefetch(ptr)
+#else
+#define BST_PREFETCH(ptr) ((void)0)
+#endif
+
+/**
+* The default ordering for lookups. It is used in both directions, so any type
+* that can be compared against Key with < (e.g. std::string_view against
+* std::string) can be searched for without building a temporary Key.
+*/
+struct KeyLess
+{
+    template<typename A, typename B>
+    bool operator()(const A& a, const B& b) const { return a < b; }
+};
+
+/**
+* A prefix to look up with PrefixLess. Wrapping it keeps the prefix apart from
+* the keys it is compared with, which are usually of the same string type.
+*/
+template<typename Str>
+struct PrefixOf
+{
+    explicit PrefixOf(const Str& p) : prefix(p) { }
+    const Str& prefix;
+};
+
+/**
+* Orders string-like keys against a PrefixOf as if every key were cut down to
+* the length of the prefix, so all keys starting with the prefix compare equal
+* to it and form one contiguous run of the tree.
+*/
+struct PrefixLess
+{
+    template<typename Str>
+    bool operator()(const Str& key, const PrefixOf<Str>& p) const
+    { return key.compare(0, p.prefix.size(), p.prefix) < 0; }
+    template<typename Str>
+    bool operator()(const PrefixOf<Str>& p, const Str& key) const
+    { return key.compare(0, p.prefix.size(), p.prefix) > 0; }
+};
+
 /**
 * A templated unbalanced binary search tree.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Alloc = NodeArena>
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    BinarySearchTree(const BinarySearchTree<Key, Value, Alloc>& other);
+    BinarySearchTree(BinarySearchTree<Key, Value, Alloc>&& other);
     virtual ~BinarySearchTree(); //TODO
+    BinarySearchTree<Key, Value, Alloc>& operator=(const BinarySearchTree<Key, Value, Alloc>& other);
+    BinarySearchTree<Key, Value, Alloc>& operator=(BinarySearchTree<Key, Value, Alloc>&& other);
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
     bool isBalanced() const; //TODO
     void print() const;
     bool empty() const;
+    std::size_t size() const;
+    void reserve(std::size_t n);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
+    * It is bidirectional: the end position is a null node that still knows
+    * its tree, so --end() steps back onto the largest item. A full scan in
+    * either direction visits every edge twice, so steps are O(1) amortized.
     */
+    class const_iterator;
+
     class iterator  // TODO
     {
     public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
         iterator();
 
         std::pair<const Key,Value>& operator*() const;
@@ -217,24 +358,107 @@ public:
 
         bool operator==(const iterator& rhs) const;
         bool operator!=(const iterator& rhs) const;
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
 
         iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
-        iterator(Node<Key,Value>* ptr);
+        friend class BinarySearchTree<Key, Value, Alloc>;
+        iterator(Node<Key,Value>* ptr, const BinarySearchTree<Key, Value, Alloc>* tree);
         Node<Key, Value>* current_;
+        const BinarySearchTree<Key, Value, Alloc>* tree_;
     };
 
+    /**
+    * The read-only counterpart of iterator. Every iterator converts to one.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    private:
+        iterator it_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
 public:
-    iterator begin() const;
-    iterator end() const;
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin();
+    reverse_iterator rend();
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+    const_reverse_iterator crbegin() const;
+    const_reverse_iterator crend() const;
     iterator find(const Key& key) const;
+    template<typename K> iterator find(const K& key) const;
+    template<typename K, typename Compare> iterator find(const K& key, Compare less) const;
+    template<typename K> iterator lower_bound(const K& key) const;
+    template<typename K, typename Compare> iterator lower_bound(const K& key, Compare less) const;
+    template<typename K> iterator upper_bound(const K& key) const;
+    template<typename K, typename Compare> iterator upper_bound(const K& key, Compare less) const;
+
+    /**
+    * A half-open run [begin(), end()) of the tree, usable in a range-based for.
+    * It is only a pair of iterators, so it is invalidated like them.
+    */
+    class range_view
+    {
+    public:
+        range_view(const iterator& first, const iterator& last);
+        iterator begin() const;
+        iterator end() const;
+        bool empty() const;
+    private:
+        iterator first_;
+        iterator last_;
+    };
+
+    template<typename K> std::pair<iterator, iterator> equal_range(const K& key) const;
+    template<typename K, typename Compare> std::pair<iterator, iterator> equal_range(const K& key, Compare less) const;
+    template<typename K> range_view range(const K& lo, const K& hi) const;
+    range_view prefixRange(const Key& prefix) const;
+    virtual std::size_t erase(const Key& lo, const Key& hi);
 
 protected:
+    BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign);
+
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    template<typename K, typename Compare> Node<Key, Value>* internalFind(const K& k, Compare less) const;
+    template<typename K, typename Compare> Node<Key, Value>* lowerBoundNode(const K& k, Compare less) const;
+    template<typename K, typename Compare> Node<Key, Value>* upperBoundNode(const K& k, Compare less) const;
     Node<Key, Value>* getSmallestNode() const;  // TODO
+    Node<Key, Value>* getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
     //        and instead just use the input argument.
@@ -246,17 +470,30 @@ protected:
     // Add helper functions here
     Node<Key, Value>* add(const std::pair<const Key, Value>& keyValuePair, Node<Key, Value>* parent);
     static Node<Key, Value>* successor(Node<Key, Value>* current);  
-    Node<Key, Value>* internalFinder(const Key& key, Node<Key, Value>* curr) const;
     void clearer(Node<Key, Value>* root);
+    void clearNodes();
+    Node<Key, Value>* cloneTree(const Node<Key, Value>* src);
+    virtual Node<Key, Value>* cloneNode(const Node<Key, Value>* src, Node<Key, Value>* parent);
     bool balanced(Node<Key, Value>* root) const;
     int height(Node<Key, Value>* root) const; 
     void AVLinsert(const pair<const Key, Value>& keyValuePair);
+    template<typename... Args> Node<Key, Value>* createNode(Node<Key, Value>* parent, Args&&... args);
+    iterator makeIterator(Node<Key, Value>* node) const;
+    // Upkeep of the in-order threads; these do nothing unless BST_THREADED is defined.
+    static void threadJoin(Node<Key, Value>* before, Node<Key, Value>* after);
+    static void threadInsert(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft);
+    static void threadRemove(Node<Key, Value>* node);
+    static void rethread(Node<Key, Value>* root);
+    virtual void destroyNode(Node<Key, Value>* node);
 
 
 
 protected:
     Node<Key, Value>* root_;
-    // You should not need other data members
+    // Number of items in the tree
+    std::size_t size_;
+    // Storage for the nodes, sized for whichever node type the tree uses
+    Alloc alloc_;
 };
 
 /*
@@ -268,9 +505,9 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
-    : current_(ptr)
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::iterator::iterator(Node<Key,Value> *ptr, const BinarySearchTree<Key, Value, Alloc>* tree)
+    : current_(ptr), tree_(tree)
 {
     // TODO
 
@@ -279,9 +516,9 @@ BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
-    : current_(NULL)
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::iterator::iterator() 
+    : current_(NULL), tree_(NULL)
 {
     // TODO
 
@@ -290,9 +527,9 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Alloc>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -300,9 +537,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Alloc>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -311,10 +548,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Alloc>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Alloc>::iterator& rhs) const
 {
     // TODO
     return (this->current_ == rhs.current_); 
@@ -324,25 +561,46 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Alloc>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Alloc>::iterator& rhs) const
 {
     // TODO
     return (this->current_ != rhs.current_);
 
 }
 
+/**
+* Comparisons against a const_iterator, so either kind can be checked against end().
+*/
+template<class Key, class Value, class Alloc>
+bool
+BinarySearchTree<Key, Value, Alloc>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Alloc>::const_iterator& rhs) const
+{
+    return const_iterator(*this) == rhs;
+}
+
+template<class Key, class Value, class Alloc>
+bool
+BinarySearchTree<Key, Value, Alloc>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Alloc>::const_iterator& rhs) const
+{
+    return const_iterator(*this) != rhs;
+}
 
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator&
+BinarySearchTree<Key, Value, Alloc>::iterator::operator++()
 {
     // TODO
+#ifdef BST_THREADED
+	current_ = current_->getNext();
+#else
 	if (current_->getRight() != NULL) {
 		current_ = current_->getRight();
 		while (current_->getLeft() != NULL) {
@@ -359,9 +617,45 @@ BinarySearchTree<Key, Value>::iterator::operator++()
 		}
 		current_ = parent;
 	}
+#endif
 	return *this;
 }
 
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+/**
+* Steps back to the previous item in order. Stepping back from
+* end() lands on the largest item.
+*/
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator&
+BinarySearchTree<Key, Value, Alloc>::iterator::operator--()
+{
+    if (current_ == NULL) current_ = tree_->getLargestNode();
+#ifdef BST_THREADED
+    else current_ = current_->getPrev();
+#else
+    else current_ = predecessor(current_);
+#endif
+    return *this;
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
 
 /*
 -------------------------------------------------------------
@@ -369,6 +663,95 @@ End implementations for the BinarySearchTree::iterator class.
 -------------------------------------------------------------
 */
 
+/*
+--------------------------------------------------------------------
+Begin implementations for the BinarySearchTree::const_iterator class.
+--------------------------------------------------------------------
+*/
+
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::const_iterator::const_iterator()
+{
+
+}
+
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::const_iterator::const_iterator(const iterator& it)
+    : it_(it)
+{
+
+}
+
+template<class Key, class Value, class Alloc>
+const std::pair<const Key,Value> &
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator*() const
+{
+    return *it_;
+}
+
+template<class Key, class Value, class Alloc>
+const std::pair<const Key,Value> *
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+template<class Key, class Value, class Alloc>
+bool
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator==(
+    const BinarySearchTree<Key, Value, Alloc>::const_iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<class Key, class Value, class Alloc>
+bool
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator!=(
+    const BinarySearchTree<Key, Value, Alloc>::const_iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator&
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++it_;
+    return old;
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator&
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Alloc>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --it_;
+    return old;
+}
+
+/*
+------------------------------------------------------------------
+End implementations for the BinarySearchTree::const_iterator class.
+------------------------------------------------------------------
+*/
+
 /*
 -----------------------------------------------------
 Begin implementations for the BinarySearchTree class.
@@ -378,32 +761,122 @@ Begin implementations for the BinarySearchTree class.
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
-    : root_(NULL)
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::BinarySearchTree() 
+    : root_(NULL), size_(0), alloc_(sizeof(Node<Key, Value>), alignof(Node<Key, Value>))
 {
     // TODO
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Constructor for derived trees whose nodes are larger than a plain Node.
+*/
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::BinarySearchTree(std::size_t nodeSize, std::size_t nodeAlign) 
+    : root_(NULL), size_(0), alloc_(nodeSize, nodeAlign)
+{
+
+}
+
+/**
+* Deep copy. The copy gets its own allocator and an identically shaped tree.
+*/
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::BinarySearchTree(const BinarySearchTree<Key, Value, Alloc>& other) 
+    : root_(NULL), size_(0), alloc_(sizeof(Node<Key, Value>), alignof(Node<Key, Value>))
+{
+    root_ = cloneTree(other.root_);
+    size_ = other.size_;
+}
+
+/**
+* Move constructor. The nodes stay where they are, so the allocator that owns
+* them moves along with the root.
+*/
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::BinarySearchTree(BinarySearchTree<Key, Value, Alloc>&& other) 
+    : root_(other.root_), size_(other.size_), alloc_(std::move(other.alloc_))
+{
+    other.root_ = NULL;
+    other.size_ = 0;
+}
+
+/**
+* Frees every node. Derived trees whose nodes need their own destroyNode() must
+* call clear() from their own destructor, since by the time this one runs the
+* derived overrides are gone.
+*/
+template<typename Key, typename Value, typename Alloc>
+BinarySearchTree<Key, Value, Alloc>::~BinarySearchTree()
 {
     // TODO
-    //clear();
+    clear();
+}
 
+/**
+* Copy assignment. cloneNode() is virtual, so derived trees copy their own
+* node type through this as well.
+*/
+template<typename Key, typename Value, typename Alloc>
+BinarySearchTree<Key, Value, Alloc>&
+BinarySearchTree<Key, Value, Alloc>::operator=(const BinarySearchTree<Key, Value, Alloc>& other)
+{
+    if (this != &other) {
+        clearNodes();
+        root_ = cloneTree(other.root_);
+        size_ = other.size_;
+    }
+    return *this;
+}
+
+/**
+* Move assignment.
+*/
+template<typename Key, typename Value, typename Alloc>
+BinarySearchTree<Key, Value, Alloc>&
+BinarySearchTree<Key, Value, Alloc>::operator=(BinarySearchTree<Key, Value, Alloc>&& other)
+{
+    if (this != &other) {
+        clearNodes();
+        alloc_ = std::move(other.alloc_);
+        root_ = other.root_;
+        size_ = other.size_;
+        other.root_ = NULL;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+/**
+ * Returns the number of items, in O(1)
+*/
+template<class Key, class Value, class Alloc>
+std::size_t BinarySearchTree<Key, Value, Alloc>::size() const
+{
+    return size_;
 }
 
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Alloc>
+bool BinarySearchTree<Key, Value, Alloc>::empty() const
 {
     return root_ == NULL;
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+* Preallocates room for n nodes so the allocator does not have to grow while
+* the tree is being filled.
+*/
+template<class Key, class Value, class Alloc>
+void BinarySearchTree<Key, Value, Alloc>::reserve(std::size_t n)
+{
+    alloc_.reserve(n);
+}
+
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
@@ -412,77 +885,298 @@ void BinarySearchTree<Key, Value>::print() const
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::begin()
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Alloc>::iterator begin(getSmallestNode(), this);
     return begin;
 }
 
 /**
 * Returns an iterator whose value means INVALID
+* (one past the largest item, so it can be decremented)
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::end()
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Alloc>::iterator end(NULL, this);
     return end;
 }
 
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Alloc>::begin() const
+{
+    return makeIterator(getSmallestNode());
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Alloc>::end() const
+{
+    return makeIterator(NULL);
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Alloc>::cbegin() const
+{
+    return begin();
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_iterator
+BinarySearchTree<Key, Value, Alloc>::cend() const
+{
+    return end();
+}
+
+/**
+* Reverse iteration runs from the largest item down, by way of
+* iterator::operator--.
+*/
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Alloc>::rbegin()
+{
+    return reverse_iterator(end());
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::reverse_iterator
+BinarySearchTree<Key, Value, Alloc>::rend()
+{
+    return reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc>::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc>::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc>::crbegin() const
+{
+    return rbegin();
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::const_reverse_iterator
+BinarySearchTree<Key, Value, Alloc>::crend() const
+{
+    return rend();
+}
+
 /**
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::find(const Key & k) const
 {
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BinarySearchTree<Key, Value, Alloc>::iterator it(curr, this);
     return it;
 }
 
+/**
+* Heterogeneous find: k can be any type ordered against Key with <.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::find(const K& k) const
+{
+    return makeIterator(internalFind(k, KeyLess()));
+}
+
+/**
+* Heterogeneous find with a caller supplied ordering, which must accept
+* (Key, K) and (K, Key) and agree with the order of the tree.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K, typename Compare>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::find(const K& k, Compare less) const
+{
+    return makeIterator(internalFind(k, less));
+}
+
+/**
+* Returns an iterator to the first item whose key is not less than k,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::lower_bound(const K& k) const
+{
+    return makeIterator(lowerBoundNode(k, KeyLess()));
+}
+
+template<class Key, class Value, class Alloc>
+template<typename K, typename Compare>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::lower_bound(const K& k, Compare less) const
+{
+    return makeIterator(lowerBoundNode(k, less));
+}
+
+/**
+* Returns an iterator to the first item whose key is greater than k,
+* or the end iterator if there is none.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::upper_bound(const K& k) const
+{
+    return makeIterator(upperBoundNode(k, KeyLess()));
+}
+
+template<class Key, class Value, class Alloc>
+template<typename K, typename Compare>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::upper_bound(const K& k, Compare less) const
+{
+    return makeIterator(upperBoundNode(k, less));
+}
+
+template<class Key, class Value, class Alloc>
+BinarySearchTree<Key, Value, Alloc>::range_view::range_view(const iterator& first, const iterator& last) :
+    first_(first), last_(last)
+{
+
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::range_view::begin() const
+{
+    return first_;
+}
+
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::range_view::end() const
+{
+    return last_;
+}
+
+template<class Key, class Value, class Alloc>
+bool BinarySearchTree<Key, Value, Alloc>::range_view::empty() const
+{
+    return first_ == last_;
+}
+
+/**
+* Returns the run of items whose key is equivalent to k, as
+* (lower_bound(k), upper_bound(k)).
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+std::pair<typename BinarySearchTree<Key, Value, Alloc>::iterator, typename BinarySearchTree<Key, Value, Alloc>::iterator>
+BinarySearchTree<Key, Value, Alloc>::equal_range(const K& k) const
+{
+    return equal_range(k, KeyLess());
+}
+
+template<class Key, class Value, class Alloc>
+template<typename K, typename Compare>
+std::pair<typename BinarySearchTree<Key, Value, Alloc>::iterator, typename BinarySearchTree<Key, Value, Alloc>::iterator>
+BinarySearchTree<Key, Value, Alloc>::equal_range(const K& k, Compare less) const
+{
+    return std::make_pair(makeIterator(lowerBoundNode(k, less)), makeIterator(upperBoundNode(k, less)));
+}
+
+/**
+* Returns the items with lo <= key < hi. Finding the run is two descents, and
+* walking it costs O(number of items + log n). Empty unless lo < hi.
+*/
+template<class Key, class Value, class Alloc>
+template<typename K>
+typename BinarySearchTree<Key, Value, Alloc>::range_view
+BinarySearchTree<Key, Value, Alloc>::range(const K& lo, const K& hi) const
+{
+    if (!(lo < hi)) return range_view(makeIterator(NULL), makeIterator(NULL));
+    return range_view(lower_bound(lo), lower_bound(hi));
+}
+
+/**
+* Returns the items whose key starts with prefix, e.g. every course
+* numbered "CSCI1..". Key must be a string type with compare().
+*/
+template<class Key, class Value, class Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::range_view
+BinarySearchTree<Key, Value, Alloc>::prefixRange(const Key& prefix) const
+{
+    PrefixOf<Key> p(prefix);
+    return range_view(lower_bound(p, PrefixLess()), upper_bound(p, PrefixLess()));
+}
+
+/**
+* Removes every item with lo <= key < hi and returns how many there were.
+* The plain tree just removes them one at a time; balanced trees override
+* this with something cheaper.
+*/
+template<class Key, class Value, class Alloc>
+std::size_t BinarySearchTree<Key, Value, Alloc>::erase(const Key& lo, const Key& hi)
+{
+    std::size_t erased = 0;
+    if (!(lo < hi)) return erased;
+    Node<Key, Value>* curr = lowerBoundNode(lo, KeyLess());
+    while (curr != NULL && curr->getKey() < hi) {
+        // copy the key, the node it lives in is about to go away
+        Key key = curr->getKey();
+        remove(key);
+        erased++;
+        curr = lowerBoundNode(key, KeyLess());
+    }
+    return erased;
+}
+
 /**
 * An insert method to insert into a Binary Search Tree.
 * The tree will not remain balanced when inserting.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Alloc>
 void
-BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+BinarySearchTree<Key, Value, Alloc>::insert(const std::pair<const Key, Value>& keyValuePair)
 {
-    //cout << "BST adding " << keyValuePair.first << endl;
     // TODO
-    if (root_ == NULL) {
-        root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL); 
-        return; 
-    }
-
-    // if key already exists 
-    Node<Key, Value>* x = internalFind(keyValuePair.first);
-    if (x != NULL) {
-        x->setValue(keyValuePair.second); 
-        return;
-    }
-
-    // find where the node fits  
-    Node<Key, Value>* root = root_; 
-    Node<Key, Value>* parent = root; 
-    Key curr = keyValuePair.first;
-    while (root != NULL) {
-        if (root->getKey() > curr) {
-            parent = root; 
-            root = root->getLeft();
-        }
-        else {
-            parent = root; 
-            root = root->getRight(); 
+    // a single descent either finds the key or the empty spot it belongs in
+    Node<Key, Value>* parent = NULL;
+    Node<Key, Value>* curr = root_;
+    bool goLeft = false;
+    while (curr != NULL) {
+        parent = curr;
+        goLeft = keyValuePair.first < curr->getKey();
+        if (!goLeft && !(curr->getKey() < keyValuePair.first)) {
+            curr->setValue(keyValuePair.second);
+            return;
         }
+        curr = goLeft ? curr->getLeft() : curr->getRight();
     }
-    Node<Key, Value>* node = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent);
-    if (parent->getKey() > curr) parent->setLeft(node);
+
+    Node<Key, Value>* node = createNode(parent, keyValuePair.first, keyValuePair.second);
+    if (parent == NULL) root_ = node;
+    else if (goLeft) parent->setLeft(node);
     else parent->setRight(node);
+    threadInsert(node, parent, goLeft);
+    size_++;
 }
 
 /**
@@ -491,151 +1185,50 @@ BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValue
 */
 
 // template<typename Key, typename Value>
-// void BinarySearchTree<Key, Value>::remove(const Key& key)
+// void BinarySearchTree<Key, Value, Alloc>::remove(const Key& key)
 // {
     
 // }
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::remove(const Key& key)
 {
     // TODO
-    //cout << "removing " << key << endl; 
     Node<Key, Value>* removedNode = internalFind(key);
-    if (removedNode == NULL) return;  
-    Node<Key, Value>* parent = removedNode->getParent(); 
-    Node<Key, Value>* left = removedNode->getLeft(); 
-    Node<Key, Value>* right = removedNode->getRight(); 
-
-    // if it is the root 
-    if (parent == NULL) {
-        //cout << "removing root" << endl;
-        // if the root has no children 
-        if (left == NULL && right == NULL) root_ = NULL; 
-        // if the root does have children 
-        else if (left != NULL && right == NULL) {
-            left->setParent(NULL);
-            root_ = left; 
-        }
-        else if (right != NULL && left == NULL) {
-            //cout << "test" << endl;
-            right->setParent(NULL);
-            root_ = right;
-        }
-
-        // if the root has two children 
-        else if (left != NULL && right != NULL) {
-            //cout << "removing node with two children " << key << endl;
-            Node<Key, Value>* succ = successor(removedNode);
-            nodeSwap(removedNode, succ);
-            //cout << succ->getLeft()->getKey() << " " << succ->getRight()->getKey() << endl;
-
-            // if succ was a leaf node 
-            if (removedNode->getLeft() == NULL && removedNode->getRight() == NULL) {
-                //cout << removedNode->getParent()->getKey() << endl; 
-                if (removedNode->getParent()->getLeft() == removedNode) {
-                    removedNode->getParent()->setLeft(removedNode->getRight());
-                }
-                else if (removedNode->getParent()->getRight() == removedNode) {
-                    removedNode->getParent()->setRight(removedNode->getRight());
-                }
-            }
-            // if succ had a child 
-            else if (removedNode->getRight() != NULL) {
-                //cout << "test " << removedNode->getRight()->getKey() << endl;
-                if (removedNode->getParent()->getLeft() == removedNode) {
-                    removedNode->getParent()->setLeft(removedNode->getRight());
-                    removedNode->getRight()->setParent(removedNode->getParent());
-                }
-                else if (removedNode->getParent()->getRight() == removedNode) {
-                    removedNode->getParent()->setRight(removedNode->getRight());
-                    removedNode->getRight()->setParent(removedNode->getParent());
-                }
-            }
-        }
-    }
-
-    // if it is a leaf node 
-    else if (left == NULL && right == NULL) {
-        if (parent != NULL) {
-            //cout << "removing leaf node " << key << endl;
-            if (parent->getLeft() == removedNode) parent->setLeft(NULL);
-            else parent->setRight(NULL); 
-        }
-    }
+    if (removedNode == NULL) return;
 
-    // if it has two children 
-    else if (left != NULL && right != NULL) {
-        //cout << "removing node with two children " << key << endl;
-        Node<Key, Value>* succ = successor(removedNode);
-        nodeSwap(removedNode, succ);
-        //cout << succ->getKey() << endl;
-        //cout << succ->getLeft()->getKey() << " " << succ->getRight()->getKey() << endl;
-
-        // if succ was a leaf node 
-        if (removedNode->getLeft() == NULL && removedNode->getRight() == NULL) {
-            //cout << removedNode->getParent()->getKey() << endl; 
-            if (removedNode->getParent()->getLeft() == removedNode) {
-                removedNode->getParent()->setLeft(removedNode->getRight());
-            }
-            else if (removedNode->getParent()->getRight() == removedNode) {
-                removedNode->getParent()->setRight(removedNode->getRight());
-            }
-        }
-        // if succ had a child 
-        else if (removedNode->getRight() != NULL) {
-            //cout << "test " << removedNode->getRight()->getKey() << endl;
-            if (removedNode->getParent()->getLeft() == removedNode) {
-                removedNode->getParent()->setLeft(removedNode->getRight());
-                removedNode->getRight()->setParent(removedNode->getParent());
-            }
-            else if (removedNode->getParent()->getRight() == removedNode) {
-                removedNode->getParent()->setRight(removedNode->getRight());
-                removedNode->getRight()->setParent(removedNode->getParent());
-            }
-        }
+    // if it has two children, trade places with the successor, which has at most one child
+    if (removedNode->getLeft() != NULL && removedNode->getRight() != NULL) {
+        nodeSwap(removedNode, successor(removedNode));
     }
 
-    // if it has one child 
-    else {
-        //cout << "removing node with one child " << key << endl; 
-        if (left != NULL) {
-            nodeSwap(removedNode, left);
-            if (removedNode->getLeft() == NULL && removedNode->getRight() == NULL) {
-                //cout << removedNode->getParent()->getKey() << endl; 
-                if (removedNode->getParent()->getLeft() == removedNode) {
-                    removedNode->getParent()->setLeft(removedNode->getRight());
-                }
-                else if (removedNode->getParent()->getRight() == removedNode) {
-                    removedNode->getParent()->setRight(removedNode->getRight());
-                }
-            }
-            if (removedNode->getLeft() != NULL) {
-                removedNode->getLeft()->setParent(left);
-                left->setLeft(removedNode->getLeft()); 
-            }
-            if (removedNode->getRight() != NULL) {
-                removedNode->getRight()->setParent(left);
-                left->setRight(removedNode->getRight()); 
-            }
-        }
-        else if (right != NULL) {
-            //cout << "removing node with one child " << key << endl; 
-            nodeSwap(removedNode, right);
-            right->setRight(NULL); 
-            
-        }
-
-    }
-    //cout << "removed" << endl; 
-    delete removedNode; 
+    // splice the node out, promoting its only child (if any)
+    Node<Key, Value>* child = removedNode->getLeft();
+    if (child == NULL) child = removedNode->getRight();
+    Node<Key, Value>* parent = removedNode->getParent();
+    if (child != NULL) child->setParent(parent);
+    if (parent == NULL) root_ = child;
+    else if (parent->getLeft() == removedNode) parent->setLeft(child);
+    else parent->setRight(child);
+    threadRemove(removedNode);
+    destroyNode(removedNode);
+    size_--;
 }
 
-template<class Key, class Value>
+template<class Key, class Value, class Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Alloc>::predecessor(Node<Key, Value>* current)
 {
     // TODO
     //credit: CP Lin
+    // the largest item of the left subtree comes first, if there is one
+    if (current->getLeft() != NULL) {
+        current = current->getLeft();
+        while (current->getRight() != NULL) {
+            current = current->getRight();
+        }
+        return current;
+    }
+
     auto parent = current->getParent();
 
     while (parent != NULL && current == parent->getLeft()){
@@ -648,9 +1241,9 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
     return current;
 }
 
-template<class Key, class Value>
+template<class Key, class Value, class Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Alloc>::successor(Node<Key, Value>* current)
 {
     //cout << "getting successor of " << current->getKey();
     // TODO
@@ -687,31 +1280,221 @@ BinarySearchTree<Key, Value>::successor(Node<Key, Value>* current)
 
 /**
 * A method to remove all contents of the tree and
-* reset the values in the tree for use again.
+* reset the values in the tree for use again. The allocator keeps only its
+* first slab, so an emptied tree does not hold on to the memory of its peak.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::clear()
 {
     // TODO
-    clearer(root_); 
+    clearNodes();
+    alloc_.trim();
+}
+
+/**
+* Frees every node but keeps the allocator's storage, for callers that are
+* about to fill the tree again.
+*/
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::clearNodes()
+{
+    // with trivially destructible items the arena can drop every node at once
+    bool bulk = Alloc::bulkRelease && std::is_trivially_destructible<std::pair<const Key, Value> >::value;
+    if (root_ != NULL && !bulk) clearer(root_); 
     root_ = NULL; 
-    
+    size_ = 0;
+    alloc_.reset();
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clearer(Node<Key, Value>* root) {
-    if (root->getLeft() != NULL) clearer(root->getLeft());
-    if (root->getRight() != NULL) clearer (root->getRight());
-    delete root; 
+/**
+* Frees the subtree in O(n) time and O(1) space, however deep it is: whenever the
+* current node has a left child we rotate right, so the left spine is unrolled
+* into the right one, and a node is only freed once it has no left child.
+* Parent links are ignored since every node is going away.
+*/
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::clearer(Node<Key, Value>* root) {
+    while (root != NULL) {
+        Node<Key, Value>* left = root->getLeft();
+        if (left != NULL) {
+            root->setLeft(left->getRight());
+            left->setRight(root);
+            root = left;
+        }
+        else {
+            Node<Key, Value>* right = root->getRight();
+            destroyNode(root);
+            root = right;
+        }
+    }
+}
+
+/**
+* Copies the subtree at src without recursion, walking the source and the copy
+* in lockstep: step down into whichever child of src has not been copied yet,
+* and climb back up through the parent links once both have been.
+*/
+template<typename Key, typename Value, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc>::cloneTree(const Node<Key, Value>* src)
+{
+    if (src == NULL) return NULL;
+    Node<Key, Value>* copyRoot = cloneNode(src, NULL);
+    const Node<Key, Value>* s = src;
+    Node<Key, Value>* d = copyRoot;
+    while (true) {
+        if (s->getLeft() != NULL && d->getLeft() == NULL) {
+            d->setLeft(cloneNode(s->getLeft(), d));
+            s = s->getLeft();
+            d = d->getLeft();
+        }
+        else if (s->getRight() != NULL && d->getRight() == NULL) {
+            d->setRight(cloneNode(s->getRight(), d));
+            s = s->getRight();
+            d = d->getRight();
+        }
+        else if (s == src) {
+            break;
+        }
+        else {
+            s = s->getParent();
+            d = d->getParent();
+        }
+    }
+    rethread(copyRoot);
+    return copyRoot;
+}
+
+/**
+* Makes an unlinked copy of a single node under the given parent.
+*/
+template<typename Key, typename Value, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc>::cloneNode(const Node<Key, Value>* src, Node<Key, Value>* parent)
+{
+    return createNode(parent, src->getItem());
+}
+
+/**
+* Constructs a node in storage taken from the tree's allocator, forwarding the
+* arguments to the item's constructor.
+*/
+template<typename Key, typename Value, typename Alloc>
+template<typename... Args>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc>::createNode(Node<Key, Value>* parent, Args&&... args)
+{
+    void* mem = alloc_.allocate();
+    try {
+        return new (mem) Node<Key, Value>(parent, std::forward<Args>(args)...);
+    }
+    catch (...) {
+        alloc_.deallocate(mem);
+        throw;
+    }
+}
+
+/**
+* Lets derived trees hand out iterators to nodes they found themselves.
+*/
+template<typename Key, typename Value, typename Alloc>
+typename BinarySearchTree<Key, Value, Alloc>::iterator
+BinarySearchTree<Key, Value, Alloc>::makeIterator(Node<Key, Value>* node) const
+{
+    return iterator(node, this);
+}
+
+/**
+* Makes before and after neighbours in the in-order list. Either may be NULL.
+*/
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::threadJoin(Node<Key, Value>* before, Node<Key, Value>* after)
+{
+#ifdef BST_THREADED
+    if (before != NULL) before->setNext(after);
+    if (after != NULL) after->setPrev(before);
+#else
+    (void)before;
+    (void)after;
+#endif
+}
+
+/**
+* Threads a new leaf in next to its parent, in O(1): a left child comes just
+* before its parent and a right child just after it.
+*/
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::threadInsert(Node<Key, Value>* node, Node<Key, Value>* parent, bool goLeft)
+{
+#ifdef BST_THREADED
+    if (parent == NULL) {
+        threadJoin(node, NULL);
+        threadJoin(NULL, node);
+    }
+    else if (goLeft) {
+        threadJoin(parent->getPrev(), node);
+        threadJoin(node, parent);
+    }
+    else {
+        threadJoin(node, parent->getNext());
+        threadJoin(parent, node);
+    }
+#else
+    (void)node;
+    (void)parent;
+    (void)goLeft;
+#endif
+}
+
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::threadRemove(Node<Key, Value>* node)
+{
+#ifdef BST_THREADED
+    threadJoin(node->getPrev(), node->getNext());
+#else
+    (void)node;
+#endif
+}
+
+/**
+* Rebuilds the threads of a whole subtree with one in-order walk, for after
+* operations that reshape the tree wholesale (copies, bulk builds, set
+* operations).
+*/
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::rethread(Node<Key, Value>* root)
+{
+#ifdef BST_THREADED
+    if (root == NULL) return;
+    Node<Key, Value>* curr = root;
+    while (curr->getLeft() != NULL) curr = curr->getLeft();
+    Node<Key, Value>* prev = NULL;
+    while (curr != NULL) {
+        threadJoin(prev, curr);
+        prev = curr;
+        curr = successor(curr);
+    }
+    threadJoin(prev, NULL);
+#else
+    (void)root;
+#endif
+}
+
+/**
+* Destroys a node and hands its storage back to the tree's allocator.
+* Node has no virtual destructor, so trees with derived nodes override this.
+*/
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::destroyNode(Node<Key, Value>* node)
+{
+    node->~Node<Key, Value>();
+    alloc_.deallocate(node);
 }
 
 
 /**
 * A helper function to find the smallest node in the tree.
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Alloc>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Alloc>::getSmallestNode() const
 {
     // TODO
     Node<Key, Value>* min = root_;
@@ -722,51 +1505,112 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
     return min; 
 }
 
+template<typename Key, typename Value, typename Alloc>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Alloc>::getLargestNode() const
+{
+    Node<Key, Value>* max = root_;
+    if (max == NULL) return NULL;
+    while (max->getRight() != NULL) {
+        max = max->getRight();
+    }
+    return max;
+}
+
 /**
 * Helper function to find a node with given key, k and
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Alloc>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc>::internalFind(const Key& key) const
 {
     // TODO
-    return internalFinder(key, root_);
+    return internalFind(key, KeyLess());
 
 }
 
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFinder(const Key& key, Node<Key, Value>* curr) const
+/**
+* Iterative lookup. Keys are only ever compared by reference, and both children
+* are prefetched while the current key is being compared, so the next level is
+* usually in cache by the time we step down to it. The match test comes first as
+* a rarely taken branch, leaving the step down as a select on goRight.
+*/
+template<typename Key, typename Value, typename Alloc>
+template<typename K, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc>::internalFind(const K& key, Compare less) const
 {
-    // TODO
-    if (curr == NULL) return NULL;
-    Key currKey = curr->getKey(); 
-    if (currKey == key) return curr; 
-    if (currKey < key) return internalFinder(key, curr->getRight());
-    else return internalFinder(key, curr->getLeft());
+    Node<Key, Value>* curr = root_;
+    while (curr != NULL) {
+        BST_PREFETCH(curr->getLeft());
+        BST_PREFETCH(curr->getRight());
+        bool goLeft = less(key, curr->getKey());
+        bool goRight = less(curr->getKey(), key);
+        if (!goLeft && !goRight) return curr;
+        curr = goRight ? curr->getRight() : curr->getLeft();
+    }
+    return NULL;
+}
+
+/**
+* Finds the first node whose key is not less than key, or NULL.
+*/
+template<typename Key, typename Value, typename Alloc>
+template<typename K, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc>::lowerBoundNode(const K& key, Compare less) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* result = NULL;
+    while (curr != NULL) {
+        BST_PREFETCH(curr->getLeft());
+        BST_PREFETCH(curr->getRight());
+        bool goRight = less(curr->getKey(), key);
+        if (!goRight) result = curr;
+        curr = goRight ? curr->getRight() : curr->getLeft();
+    }
+    return result;
+}
+
+/**
+* Finds the first node whose key is greater than key, or NULL.
+*/
+template<typename Key, typename Value, typename Alloc>
+template<typename K, typename Compare>
+Node<Key, Value>* BinarySearchTree<Key, Value, Alloc>::upperBoundNode(const K& key, Compare less) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* result = NULL;
+    while (curr != NULL) {
+        BST_PREFETCH(curr->getLeft());
+        BST_PREFETCH(curr->getRight());
+        bool goLeft = less(key, curr->getKey());
+        if (goLeft) result = curr;
+        curr = goLeft ? curr->getLeft() : curr->getRight();
+    }
+    return result;
 }
 
 
 /**
  * Return true iff the BST is balanced.
  */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+template<typename Key, typename Value, typename Alloc>
+bool BinarySearchTree<Key, Value, Alloc>::isBalanced() const
 {
     // TODO
     return balanced(root_); 
 
 }
 
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::balanced(Node<Key, Value>* root) const {
+template<typename Key, typename Value, typename Alloc>
+bool BinarySearchTree<Key, Value, Alloc>::balanced(Node<Key, Value>* root) const {
     if (root == NULL) return true;
     if (height(root) == -1) return false;
     else return (balanced(root->getLeft()) && balanced(root->getRight())); 
 }
 
-template<typename Key, typename Value>
-int BinarySearchTree<Key, Value>::height(Node<Key, Value>* root) const {
+template<typename Key, typename Value, typename Alloc>
+int BinarySearchTree<Key, Value, Alloc>::height(Node<Key, Value>* root) const {
     // Credit CP Lin
     if (root == NULL) return 0;
     int leftHeight = height(root->getLeft());
@@ -777,8 +1621,8 @@ int BinarySearchTree<Key, Value>::height(Node<Key, Value>* root) const {
 }
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
@@ -0,0 +1,1215 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <cstddef>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "key_traits.h"
+
+/**
+* A B+-tree with the same map interface as BinarySearchTree/AVLTree
+* (insert/insert_or_assign/remove/find/lower_bound/upper_bound/begin/end).
+*
+* Each node holds up to NodeKeys keys side by side, so one cache miss brings in a
+* whole run of keys instead of a single one, and the tree is only about
+* log(n)/log(NodeKeys/2) levels deep. Every item lives in a leaf. Leaves are
+* chained in key order, so iteration walks arrays and only follows a link at the
+* end of each leaf. Inner nodes just hold separator keys: child i covers the
+* keys k with keys[i-1] <= k < keys[i].
+*
+* Leaves and inner nodes come from two allocators of the given policy. Unlike the
+* binary trees, an insert or remove can move items between slots, so it
+* invalidates every iterator into the tree.
+*/
+template <typename Key, typename Value, typename Alloc = NodeArena, std::size_t NodeKeys = 32>
+class BPlusTree
+{
+    static_assert(NodeKeys >= 4, "a B+-tree node needs room for at least 4 keys");
+
+    struct Inner;
+    struct Leaf;
+
+public:
+    BPlusTree();
+    BPlusTree(const BPlusTree<Key, Value, Alloc, NodeKeys>& other);
+    BPlusTree(BPlusTree<Key, Value, Alloc, NodeKeys>&& other);
+    ~BPlusTree();
+    BPlusTree<Key, Value, Alloc, NodeKeys>& operator=(const BPlusTree<Key, Value, Alloc, NodeKeys>& other);
+    BPlusTree<Key, Value, Alloc, NodeKeys>& operator=(BPlusTree<Key, Value, Alloc, NodeKeys>&& other);
+
+    class const_iterator;
+
+    /**
+    * A bidirectional iterator over the items in key order. end() is a null
+    * leaf that still knows its tree, so --end() reaches the largest item.
+    */
+    class iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef std::pair<const Key, Value>* pointer;
+        typedef std::pair<const Key, Value>& reference;
+
+        iterator();
+
+        std::pair<const Key,Value>& operator*() const;
+        std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+        iterator& operator--();
+        iterator operator--(int);
+
+    protected:
+        friend class BPlusTree<Key, Value, Alloc, NodeKeys>;
+        iterator(Leaf* leaf, std::size_t index, const BPlusTree<Key, Value, Alloc, NodeKeys>* tree);
+        Leaf* leaf_;
+        std::size_t index_;
+        const BPlusTree<Key, Value, Alloc, NodeKeys>* tree_;
+    };
+
+    /**
+    * The read-only counterpart of iterator. Every iterator converts to one.
+    */
+    class const_iterator
+    {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const std::pair<const Key, Value>* pointer;
+        typedef const std::pair<const Key, Value>& reference;
+
+        const_iterator();
+        const_iterator(const iterator& it);
+
+        const std::pair<const Key,Value>& operator*() const;
+        const std::pair<const Key,Value>* operator->() const;
+
+        bool operator==(const const_iterator& rhs) const;
+        bool operator!=(const const_iterator& rhs) const;
+
+        const_iterator& operator++();
+        const_iterator operator++(int);
+        const_iterator& operator--();
+        const_iterator operator--(int);
+
+    private:
+        iterator it_;
+    };
+
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    template<typename M> std::pair<iterator, bool> insert_or_assign(const Key& key, M&& value);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    std::size_t size() const;
+    bool isValid() const;
+
+    iterator begin();
+    iterator end();
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator cbegin() const;
+    const_iterator cend() const;
+    reverse_iterator rbegin();
+    reverse_iterator rend();
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+
+    template<typename K> iterator find(const K& key) const;
+    template<typename K, typename Compare> iterator find(const K& key, Compare less) const;
+    template<typename K> iterator lower_bound(const K& key) const;
+    template<typename K, typename Compare> iterator lower_bound(const K& key, Compare less) const;
+    template<typename K> iterator upper_bound(const K& key) const;
+    template<typename K, typename Compare> iterator upper_bound(const K& key, Compare less) const;
+
+private:
+    typedef std::pair<const Key, Value> Item;
+
+    // a leaf needs at least this many items, and an inner node this many keys,
+    // unless it is the root
+    static const std::size_t minKeys = NodeKeys / 2;
+
+    struct NodeHeader
+    {
+        Inner* parent;
+        std::size_t count;   // items in a leaf, keys in an inner node
+        bool leaf;
+    };
+
+    // items and keys sit in raw storage and are only constructed while in use
+    struct Leaf : NodeHeader
+    {
+        Leaf* prev;
+        Leaf* next;
+        typename std::aligned_storage<sizeof(Item), alignof(Item)>::type slots[NodeKeys];
+        Item* items() { return reinterpret_cast<Item*>(slots); }
+    };
+
+    struct Inner : NodeHeader
+    {
+        typename std::aligned_storage<sizeof(Key), alignof(Key)>::type slots[NodeKeys];
+        NodeHeader* children[NodeKeys + 1];
+        Key* keys() { return reinterpret_cast<Key*>(slots); }
+    };
+
+    template<typename T> static void openGap(T* a, std::size_t i, std::size_t n);
+    template<typename T> static void closeGap(T* a, std::size_t i, std::size_t n);
+    template<typename K, typename Compare> static std::size_t childIndex(Inner* node, const K& key, Compare less);
+    static std::size_t childIndex(Inner* node, const Key& key, KeyLess less);
+    template<typename K, typename Compare> static std::size_t itemLowerIndex(Leaf* leaf, const K& key, Compare less);
+    template<typename K, typename Compare> static std::size_t itemUpperIndex(Leaf* leaf, const K& key, Compare less);
+    static std::size_t positionOf(Inner* parent, NodeHeader* child);
+
+    template<typename K, typename Compare> Leaf* findLeaf(const K& key, Compare less) const;
+    iterator makeIterator(Leaf* leaf, std::size_t index) const;
+
+    Leaf* createLeaf();
+    Inner* createInner();
+    void destroyLeaf(Leaf* leaf);
+    void destroyInner(Inner* node);
+    void clearer(NodeHeader* node);
+    void clearNodes();
+    bool valid(NodeHeader* node, Inner* parent, const Key* lo, const Key* hi, std::size_t depth,
+               std::size_t& leafDepth, Leaf*& prevLeaf, std::size_t& items) const;
+
+    Leaf* splitLeaf(Leaf* leaf);
+    void insertIntoParent(NodeHeader* left, const Key& key, NodeHeader* right);
+    void removeFromInner(Inner* node, std::size_t keyIndex, std::size_t childIndex);
+    void rebalanceLeaf(Leaf* leaf);
+    void rebalanceInner(Inner* node);
+    void shrinkRoot();
+
+    NodeHeader* root_;
+    Leaf* head_;   // smallest leaf, where begin() starts
+    Leaf* tail_;   // largest leaf, where --end() goes
+    std::size_t size_;
+    Alloc leafAlloc_;
+    Alloc innerAlloc_;
+};
+
+/*
+  ----------------------------------------------------------
+  Begin implementations for the BPlusTree::iterator class.
+  ----------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::iterator() :
+    leaf_(NULL), index_(0), tree_(NULL)
+{
+
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::iterator(Leaf* leaf, std::size_t index, const BPlusTree<Key, Value, Alloc, NodeKeys>* tree) :
+    leaf_(leaf), index_(index), tree_(tree)
+{
+
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+std::pair<const Key,Value>&
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator*() const
+{
+    return leaf_->items()[index_];
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+std::pair<const Key,Value>*
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator->() const
+{
+    return leaf_->items() + index_;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator==(const iterator& rhs) const
+{
+    return leaf_ == rhs.leaf_ && index_ == rhs.index_;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator==(const const_iterator& rhs) const
+{
+    return const_iterator(*this) == rhs;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator!=(const const_iterator& rhs) const
+{
+    return const_iterator(*this) != rhs;
+}
+
+/**
+* Moves to the next slot of the leaf, or to the start of the next leaf.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator&
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator++()
+{
+    if (++index_ == leaf_->count) {
+        leaf_ = leaf_->next;
+        index_ = 0;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator++(int)
+{
+    iterator old(*this);
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator&
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator--()
+{
+    if (leaf_ == NULL) {
+        leaf_ = tree_->tail_;
+        index_ = leaf_->count - 1;
+    }
+    else if (index_ == 0) {
+        leaf_ = leaf_->prev;
+        index_ = leaf_->count - 1;
+    }
+    else {
+        index_--;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::iterator::operator--(int)
+{
+    iterator old(*this);
+    --(*this);
+    return old;
+}
+
+/*
+  --------------------------------------------------------
+  End implementations for the BPlusTree::iterator class.
+  --------------------------------------------------------
+*/
+
+/*
+  ----------------------------------------------------------------
+  Begin implementations for the BPlusTree::const_iterator class.
+  ----------------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::const_iterator()
+{
+
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::const_iterator(const iterator& it) :
+    it_(it)
+{
+
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+const std::pair<const Key,Value>&
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator*() const
+{
+    return *it_;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+const std::pair<const Key,Value>*
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator->() const
+{
+    return it_.operator->();
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator==(const const_iterator& rhs) const
+{
+    return it_ == rhs.it_;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator!=(const const_iterator& rhs) const
+{
+    return it_ != rhs.it_;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator&
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator++()
+{
+    ++it_;
+    return *this;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator++(int)
+{
+    const_iterator old(*this);
+    ++it_;
+    return old;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator&
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator--()
+{
+    --it_;
+    return *this;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator::operator--(int)
+{
+    const_iterator old(*this);
+    --it_;
+    return old;
+}
+
+/*
+  --------------------------------------------------------------
+  End implementations for the BPlusTree::const_iterator class.
+  --------------------------------------------------------------
+*/
+
+/*
+  -----------------------------------------------
+  Begin implementations for the BPlusTree class.
+  -----------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::BPlusTree() :
+    root_(NULL), head_(NULL), tail_(NULL), size_(0),
+    leafAlloc_(sizeof(Leaf), alignof(Leaf)), innerAlloc_(sizeof(Inner), alignof(Inner))
+{
+
+}
+
+/**
+* The items arrive in order, so every insert lands in the last leaf.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::BPlusTree(const BPlusTree<Key, Value, Alloc, NodeKeys>& other) :
+    root_(NULL), head_(NULL), tail_(NULL), size_(0),
+    leafAlloc_(sizeof(Leaf), alignof(Leaf)), innerAlloc_(sizeof(Inner), alignof(Inner))
+{
+    for (const_iterator it = other.begin(); it != other.end(); ++it) {
+        insert(*it);
+    }
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::BPlusTree(BPlusTree<Key, Value, Alloc, NodeKeys>&& other) :
+    root_(other.root_), head_(other.head_), tail_(other.tail_), size_(other.size_),
+    leafAlloc_(std::move(other.leafAlloc_)), innerAlloc_(std::move(other.innerAlloc_))
+{
+    other.root_ = NULL;
+    other.head_ = NULL;
+    other.tail_ = NULL;
+    other.size_ = 0;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>::~BPlusTree()
+{
+    clear();
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>&
+BPlusTree<Key, Value, Alloc, NodeKeys>::operator=(const BPlusTree<Key, Value, Alloc, NodeKeys>& other)
+{
+    if (this != &other) {
+        clearNodes();
+        for (const_iterator it = other.begin(); it != other.end(); ++it) {
+            insert(*it);
+        }
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+BPlusTree<Key, Value, Alloc, NodeKeys>&
+BPlusTree<Key, Value, Alloc, NodeKeys>::operator=(BPlusTree<Key, Value, Alloc, NodeKeys>&& other)
+{
+    if (this != &other) {
+        clearNodes();
+        leafAlloc_ = std::move(other.leafAlloc_);
+        innerAlloc_ = std::move(other.innerAlloc_);
+        root_ = other.root_;
+        head_ = other.head_;
+        tail_ = other.tail_;
+        size_ = other.size_;
+        other.root_ = NULL;
+        other.head_ = NULL;
+        other.tail_ = NULL;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    insert_or_assign(keyValuePair.first, keyValuePair.second);
+}
+
+/**
+* Puts the item in its leaf, splitting the leaf first if it is full. A split
+* pushes a separator into the parent, which may split in turn, up to the root.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename M>
+std::pair<typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator, bool>
+BPlusTree<Key, Value, Alloc, NodeKeys>::insert_or_assign(const Key& key, M&& value)
+{
+    if (root_ == NULL) {
+        Leaf* leaf = createLeaf();
+        root_ = head_ = tail_ = leaf;
+    }
+    Leaf* leaf = findLeaf(key, KeyLess());
+    std::size_t i = itemLowerIndex(leaf, key, KeyLess());
+    if (i < leaf->count && !(key < leaf->items()[i].first)) {
+        leaf->items()[i].second = std::forward<M>(value);
+        return std::make_pair(makeIterator(leaf, i), false);
+    }
+
+    if (leaf->count == NodeKeys) {
+        Leaf* right = splitLeaf(leaf);
+        if (i > leaf->count) {
+            i -= leaf->count;
+            leaf = right;
+        }
+    }
+    openGap(leaf->items(), i, leaf->count);
+    new (leaf->items() + i) Item(key, std::forward<M>(value));
+    leaf->count++;
+    size_++;
+    return std::make_pair(makeIterator(leaf, i), true);
+}
+
+/**
+* Takes the item out of its leaf. A leaf left less than half full borrows from
+* or merges with a sibling, which can leave the parent short in turn.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::remove(const Key& key)
+{
+    if (root_ == NULL) return;
+    Leaf* leaf = findLeaf(key, KeyLess());
+    std::size_t i = itemLowerIndex(leaf, key, KeyLess());
+    if (i == leaf->count || key < leaf->items()[i].first) return;
+
+    closeGap(leaf->items(), i, leaf->count);
+    leaf->count--;
+    size_--;
+
+    if (leaf == root_) {
+        if (leaf->count == 0) {
+            destroyLeaf(leaf);
+            root_ = head_ = tail_ = NULL;
+        }
+    }
+    else if (leaf->count < minKeys) {
+        rebalanceLeaf(leaf);
+    }
+}
+
+/**
+* Frees every node, and all but the first slab of each arena.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::clear()
+{
+    clearNodes();
+    leafAlloc_.trim();
+    innerAlloc_.trim();
+}
+
+/**
+* Frees every node but keeps the storage for refilling. As with the binary
+* trees, an arena that releases everything on reset() lets us skip the walk
+* when the items need no destructor.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::clearNodes()
+{
+    if (!(Alloc::bulkRelease && std::is_trivially_destructible<Item>::value
+          && std::is_trivially_destructible<Key>::value)) {
+        if (root_ != NULL) clearer(root_);
+    }
+    root_ = head_ = tail_ = NULL;
+    size_ = 0;
+    leafAlloc_.reset();
+    innerAlloc_.reset();
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::empty() const
+{
+    return size_ == 0;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+std::size_t BPlusTree<Key, Value, Alloc, NodeKeys>::size() const
+{
+    return size_;
+}
+
+/**
+* Checks the whole structure: keys in order and inside their separators, every
+* node but the root at least half full, all leaves at one depth, parent links
+* and the leaf chain intact, and size() matching the items. Walks every node,
+* so it is meant for tests.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::isValid() const
+{
+    if (root_ == NULL) return head_ == NULL && tail_ == NULL && size_ == 0;
+    if (root_->count == 0) return false;
+    std::size_t leafDepth = 0;
+    Leaf* last = NULL;
+    std::size_t items = 0;
+    if (!valid(root_, NULL, NULL, NULL, 1, leafDepth, last, items)) return false;
+    return last == tail_ && last->next == NULL && items == size_;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::begin()
+{
+    return makeIterator(head_, 0);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::end()
+{
+    return makeIterator(NULL, 0);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::begin() const
+{
+    return makeIterator(head_, 0);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::end() const
+{
+    return makeIterator(NULL, 0);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::cbegin() const
+{
+    return begin();
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::cend() const
+{
+    return end();
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::reverse_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::rbegin()
+{
+    return reverse_iterator(end());
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::reverse_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::rend()
+{
+    return reverse_iterator(begin());
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_reverse_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::const_reverse_iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::find(const K& key) const
+{
+    return find(key, KeyLess());
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K, typename Compare>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::find(const K& key, Compare less) const
+{
+    if (root_ == NULL) return makeIterator(NULL, 0);
+    Leaf* leaf = findLeaf(key, less);
+    std::size_t i = itemLowerIndex(leaf, key, less);
+    if (i == leaf->count || less(key, leaf->items()[i].first)) return makeIterator(NULL, 0);
+    return makeIterator(leaf, i);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::lower_bound(const K& key) const
+{
+    return lower_bound(key, KeyLess());
+}
+
+/**
+* The answer is in the leaf that covers key, or if every item there is smaller,
+* it is the first item of the next leaf.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K, typename Compare>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::lower_bound(const K& key, Compare less) const
+{
+    if (root_ == NULL) return makeIterator(NULL, 0);
+    Leaf* leaf = findLeaf(key, less);
+    std::size_t i = itemLowerIndex(leaf, key, less);
+    if (i == leaf->count) return makeIterator(leaf->next, 0);
+    return makeIterator(leaf, i);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::upper_bound(const K& key) const
+{
+    return upper_bound(key, KeyLess());
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K, typename Compare>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::upper_bound(const K& key, Compare less) const
+{
+    if (root_ == NULL) return makeIterator(NULL, 0);
+    Leaf* leaf = findLeaf(key, less);
+    std::size_t i = itemUpperIndex(leaf, key, less);
+    if (i == leaf->count) return makeIterator(leaf->next, 0);
+    return makeIterator(leaf, i);
+}
+
+/**
+* Moves a[i, n) up one slot, leaving slot i unconstructed.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename T>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::openGap(T* a, std::size_t i, std::size_t n)
+{
+    for (std::size_t j = n; j > i; j--) {
+        new (a + j) T(std::move(a[j - 1]));
+        a[j - 1].~T();
+    }
+}
+
+/**
+* Destroys a[i] and moves a[i + 1, n) down one slot to close the hole.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename T>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::closeGap(T* a, std::size_t i, std::size_t n)
+{
+    a[i].~T();
+    for (std::size_t j = i + 1; j < n; j++) {
+        new (a + j - 1) T(std::move(a[j]));
+        a[j].~T();
+    }
+}
+
+/**
+* Which child of an inner node covers key: the number of separators <= key.
+* The in-node searches halve the range without branching on the comparison,
+* so for simple keys each step compiles to a conditional move and there is
+* nothing for the branch predictor to get wrong.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K, typename Compare>
+std::size_t BPlusTree<Key, Value, Alloc, NodeKeys>::childIndex(Inner* node, const K& key, Compare less)
+{
+    const Key* keys = node->keys();
+    const Key* base = keys;
+    std::size_t n = node->count;
+    while (n > 1) {
+        std::size_t half = n / 2;
+        base = less(key, base[half]) ? base : base + half;
+        n -= half;
+    }
+    return (base - keys) + !less(key, *base);
+}
+
+/**
+* Searching for a Key with the natural order can use the key type's own search
+* kernel, which compares a whole vector of integer keys at once (key_traits.h).
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+std::size_t BPlusTree<Key, Value, Alloc, NodeKeys>::childIndex(Inner* node, const Key& key, KeyLess)
+{
+    return KeyTraits<Key>::upperIndex(node->keys(), node->count, key);
+}
+
+/**
+* The first slot of a leaf whose key is not less than key.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K, typename Compare>
+std::size_t BPlusTree<Key, Value, Alloc, NodeKeys>::itemLowerIndex(Leaf* leaf, const K& key, Compare less)
+{
+    const Item* items = leaf->items();
+    const Item* base = items;
+    std::size_t n = leaf->count;
+    if (n == 0) return 0;
+    while (n > 1) {
+        std::size_t half = n / 2;
+        base = less(base[half].first, key) ? base + half : base;
+        n -= half;
+    }
+    return (base - items) + less(base->first, key);
+}
+
+/**
+* The first slot of a leaf whose key is greater than key.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K, typename Compare>
+std::size_t BPlusTree<Key, Value, Alloc, NodeKeys>::itemUpperIndex(Leaf* leaf, const K& key, Compare less)
+{
+    const Item* items = leaf->items();
+    const Item* base = items;
+    std::size_t n = leaf->count;
+    if (n == 0) return 0;
+    while (n > 1) {
+        std::size_t half = n / 2;
+        base = less(key, base[half].first) ? base : base + half;
+        n -= half;
+    }
+    return (base - items) + !less(key, base->first);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+std::size_t BPlusTree<Key, Value, Alloc, NodeKeys>::positionOf(Inner* parent, NodeHeader* child)
+{
+    std::size_t i = 0;
+    while (parent->children[i] != child) i++;
+    return i;
+}
+
+/**
+* Walks from the root to the leaf that covers key. The tree must not be empty.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+template<typename K, typename Compare>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::Leaf*
+BPlusTree<Key, Value, Alloc, NodeKeys>::findLeaf(const K& key, Compare less) const
+{
+    NodeHeader* curr = root_;
+    while (!curr->leaf) {
+        Inner* node = static_cast<Inner*>(curr);
+        curr = node->children[childIndex(node, key, less)];
+        BST_PREFETCH(curr);
+    }
+    return static_cast<Leaf*>(curr);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::iterator
+BPlusTree<Key, Value, Alloc, NodeKeys>::makeIterator(Leaf* leaf, std::size_t index) const
+{
+    return iterator(leaf, index, this);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::Leaf*
+BPlusTree<Key, Value, Alloc, NodeKeys>::createLeaf()
+{
+    Leaf* leaf = static_cast<Leaf*>(leafAlloc_.allocate());
+    leaf->parent = NULL;
+    leaf->count = 0;
+    leaf->leaf = true;
+    leaf->prev = NULL;
+    leaf->next = NULL;
+    return leaf;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::Inner*
+BPlusTree<Key, Value, Alloc, NodeKeys>::createInner()
+{
+    Inner* node = static_cast<Inner*>(innerAlloc_.allocate());
+    node->parent = NULL;
+    node->count = 0;
+    node->leaf = false;
+    return node;
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::destroyLeaf(Leaf* leaf)
+{
+    for (std::size_t i = 0; i < leaf->count; i++) {
+        leaf->items()[i].~Item();
+    }
+    leafAlloc_.deallocate(leaf);
+}
+
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::destroyInner(Inner* node)
+{
+    for (std::size_t i = 0; i < node->count; i++) {
+        node->keys()[i].~Key();
+    }
+    innerAlloc_.deallocate(node);
+}
+
+/**
+* Frees a subtree. The recursion is only as deep as the tree, a handful of levels.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::clearer(NodeHeader* node)
+{
+    if (node->leaf) {
+        destroyLeaf(static_cast<Leaf*>(node));
+        return;
+    }
+    Inner* inner = static_cast<Inner*>(node);
+    for (std::size_t i = 0; i <= inner->count; i++) {
+        clearer(inner->children[i]);
+    }
+    destroyInner(inner);
+}
+
+/**
+* Checks a subtree whose keys must lie in [lo, hi) where those are given. Leaves
+* are visited in key order, so each one must follow prevLeaf in the chain.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+bool BPlusTree<Key, Value, Alloc, NodeKeys>::valid(NodeHeader* node, Inner* parent, const Key* lo, const Key* hi,
+                                                   std::size_t depth, std::size_t& leafDepth, Leaf*& prevLeaf,
+                                                   std::size_t& items) const
+{
+    if (node->parent != parent || node->count > NodeKeys) return false;
+    if (node != root_ && node->count < minKeys) return false;
+
+    if (node->leaf) {
+        Leaf* leaf = static_cast<Leaf*>(node);
+        if (leafDepth == 0) leafDepth = depth;
+        if (depth != leafDepth) return false;
+        if (leaf->prev != prevLeaf) return false;
+        if (prevLeaf == NULL ? head_ != leaf : prevLeaf->next != leaf) return false;
+        for (std::size_t i = 0; i < leaf->count; i++) {
+            const Key& key = leaf->items()[i].first;
+            if (lo != NULL && key < *lo) return false;
+            if (hi != NULL && !(key < *hi)) return false;
+            if (i > 0 && !(leaf->items()[i - 1].first < key)) return false;
+        }
+        prevLeaf = leaf;
+        items += leaf->count;
+        return true;
+    }
+
+    Inner* inner = static_cast<Inner*>(node);
+    for (std::size_t i = 0; i < inner->count; i++) {
+        const Key& key = inner->keys()[i];
+        if (lo != NULL && key < *lo) return false;
+        if (hi != NULL && !(key < *hi)) return false;
+        if (i > 0 && !(inner->keys()[i - 1] < key)) return false;
+    }
+    for (std::size_t i = 0; i <= inner->count; i++) {
+        const Key* childLo = i == 0 ? lo : inner->keys() + (i - 1);
+        const Key* childHi = i == inner->count ? hi : inner->keys() + i;
+        if (!valid(inner->children[i], inner, childLo, childHi, depth + 1, leafDepth, prevLeaf, items)) return false;
+    }
+    return true;
+}
+
+/**
+* Moves the upper half of a full leaf into a new leaf to its right and hands the
+* new leaf's first key up to the parent as the separator between them.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+typename BPlusTree<Key, Value, Alloc, NodeKeys>::Leaf*
+BPlusTree<Key, Value, Alloc, NodeKeys>::splitLeaf(Leaf* leaf)
+{
+    Leaf* right = createLeaf();
+    std::size_t keep = leaf->count / 2;
+    for (std::size_t j = keep; j < leaf->count; j++) {
+        new (right->items() + (j - keep)) Item(std::move(leaf->items()[j]));
+        leaf->items()[j].~Item();
+    }
+    right->count = leaf->count - keep;
+    leaf->count = keep;
+
+    right->next = leaf->next;
+    right->prev = leaf;
+    if (leaf->next != NULL) leaf->next->prev = right;
+    else tail_ = right;
+    leaf->next = right;
+
+    insertIntoParent(leaf, right->items()[0].first, right);
+    return right;
+}
+
+/**
+* Adds key and the new node right just after left in left's parent, growing a
+* new root if left was the root. A full parent is split around its middle key,
+* which moves up a level instead of staying in either half.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::insertIntoParent(NodeHeader* left, const Key& key, NodeHeader* right)
+{
+    Inner* parent = left->parent;
+    if (parent == NULL) {
+        Inner* root = createInner();
+        new (root->keys()) Key(key);
+        root->children[0] = left;
+        root->children[1] = right;
+        root->count = 1;
+        left->parent = root;
+        right->parent = root;
+        root_ = root;
+        return;
+    }
+
+    std::size_t pos = positionOf(parent, left);
+    if (parent->count < NodeKeys) {
+        openGap(parent->keys(), pos, parent->count);
+        new (parent->keys() + pos) Key(key);
+        for (std::size_t j = parent->count + 1; j > pos + 1; j--) {
+            parent->children[j] = parent->children[j - 1];
+        }
+        parent->children[pos + 1] = right;
+        right->parent = parent;
+        parent->count++;
+        return;
+    }
+
+    // lay the overfull node out in order, then deal it back out to two nodes;
+    // this only happens once every NodeKeys/2 splits below
+    std::vector<Key> keys;
+    std::vector<NodeHeader*> children;
+    keys.reserve(NodeKeys + 1);
+    children.reserve(NodeKeys + 2);
+    for (std::size_t j = 0; j < parent->count; j++) {
+        if (j == pos) keys.push_back(key);
+        keys.push_back(std::move(parent->keys()[j]));
+        parent->keys()[j].~Key();
+    }
+    if (pos == parent->count) keys.push_back(key);
+    for (std::size_t j = 0; j <= parent->count; j++) {
+        children.push_back(parent->children[j]);
+        if (j == pos) children.push_back(right);
+    }
+
+    std::size_t mid = keys.size() / 2;
+    Inner* sibling = createInner();
+    for (std::size_t j = 0; j < mid; j++) {
+        new (parent->keys() + j) Key(std::move(keys[j]));
+        parent->children[j] = children[j];
+        children[j]->parent = parent;
+    }
+    parent->children[mid] = children[mid];
+    children[mid]->parent = parent;
+    parent->count = mid;
+    for (std::size_t j = mid + 1; j < keys.size(); j++) {
+        new (sibling->keys() + (j - mid - 1)) Key(std::move(keys[j]));
+    }
+    for (std::size_t j = mid + 1; j < children.size(); j++) {
+        sibling->children[j - mid - 1] = children[j];
+        children[j]->parent = sibling;
+    }
+    sibling->count = keys.size() - mid - 1;
+
+    insertIntoParent(parent, keys[mid], sibling);
+}
+
+/**
+* Drops a separator and the child pointer next to it from an inner node.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::removeFromInner(Inner* node, std::size_t keyIndex, std::size_t childIndex)
+{
+    closeGap(node->keys(), keyIndex, node->count);
+    for (std::size_t j = childIndex; j < node->count; j++) {
+        node->children[j] = node->children[j + 1];
+    }
+    node->count--;
+
+    if (node == root_) shrinkRoot();
+    else if (node->count < minKeys) rebalanceInner(node);
+}
+
+/**
+* An inner root with no separators left has a single child, which takes its place.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::shrinkRoot()
+{
+    Inner* root = static_cast<Inner*>(root_);
+    if (root->count > 0) return;
+    root_ = root->children[0];
+    root_->parent = NULL;
+    destroyInner(root);
+}
+
+/**
+* Refills a leaf that fell below half full: take an item from a sibling that can
+* spare one, or else merge with a sibling and drop their separator.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::rebalanceLeaf(Leaf* leaf)
+{
+    Inner* parent = leaf->parent;
+    std::size_t pos = positionOf(parent, leaf);
+    Leaf* left = pos > 0 ? static_cast<Leaf*>(parent->children[pos - 1]) : NULL;
+    Leaf* right = pos < parent->count ? static_cast<Leaf*>(parent->children[pos + 1]) : NULL;
+
+    if (left != NULL && left->count > minKeys) {
+        openGap(leaf->items(), 0, leaf->count);
+        new (leaf->items()) Item(std::move(left->items()[left->count - 1]));
+        left->items()[left->count - 1].~Item();
+        left->count--;
+        leaf->count++;
+        parent->keys()[pos - 1] = leaf->items()[0].first;
+    }
+    else if (right != NULL && right->count > minKeys) {
+        new (leaf->items() + leaf->count) Item(std::move(right->items()[0]));
+        closeGap(right->items(), 0, right->count);
+        right->count--;
+        leaf->count++;
+        parent->keys()[pos] = right->items()[0].first;
+    }
+    else {
+        // merge the right one of the pair into the left one
+        if (left == NULL) {
+            left = leaf;
+            pos++;
+        }
+        Leaf* gone = static_cast<Leaf*>(parent->children[pos]);
+        for (std::size_t j = 0; j < gone->count; j++) {
+            new (left->items() + left->count + j) Item(std::move(gone->items()[j]));
+            gone->items()[j].~Item();
+        }
+        left->count += gone->count;
+        gone->count = 0;
+        left->next = gone->next;
+        if (gone->next != NULL) gone->next->prev = left;
+        else tail_ = left;
+        destroyLeaf(gone);
+        removeFromInner(parent, pos - 1, pos);
+    }
+}
+
+/**
+* The same as rebalanceLeaf() one level up, except that separators rotate
+* through the parent instead of being copied from the children.
+*/
+template<typename Key, typename Value, typename Alloc, std::size_t NodeKeys>
+void BPlusTree<Key, Value, Alloc, NodeKeys>::rebalanceInner(Inner* node)
+{
+    Inner* parent = node->parent;
+    std::size_t pos = positionOf(parent, node);
+    Inner* left = pos > 0 ? static_cast<Inner*>(parent->children[pos - 1]) : NULL;
+    Inner* right = pos < parent->count ? static_cast<Inner*>(parent->children[pos + 1]) : NULL;
+
+    if (left != NULL && left->count > minKeys) {
+        openGap(node->keys(), 0, node->count);
+        new (node->keys()) Key(std::move(parent->keys()[pos - 1]));
+        for (std::size_t j = node->count + 1; j > 0; j--) {
+            node->children[j] = node->children[j - 1];
+        }
+        node->children[0] = left->children[left->count];
+        node->children[0]->parent = node;
+        node->count++;
+        parent->keys()[pos - 1] = std::move(left->keys()[left->count - 1]);
+        left->keys()[left->count - 1].~Key();
+        left->count--;
+    }
+    else if (right != NULL && right->count > minKeys) {
+        new (node->keys() + node->count) Key(std::move(parent->keys()[pos]));
+        node->children[node->count + 1] = right->children[0];
+        node->children[node->count + 1]->parent = node;
+        node->count++;
+        parent->keys()[pos] = std::move(right->keys()[0]);
+        closeGap(right->keys(), 0, right->count);
+        for (std::size_t j = 0; j < right->count; j++) {
+            right->children[j] = right->children[j + 1];
+        }
+        right->count--;
+    }
+    else {
+        // merge the right one of the pair, and the separator between them, into the left one
+        if (left == NULL) {
+            left = node;
+            pos++;
+        }
+        Inner* gone = static_cast<Inner*>(parent->children[pos]);
+        new (left->keys() + left->count) Key(parent->keys()[pos - 1]);
+        left->count++;
+        for (std::size_t j = 0; j < gone->count; j++) {
+            new (left->keys() + left->count + j) Key(std::move(gone->keys()[j]));
+        }
+        for (std::size_t j = 0; j <= gone->count; j++) {
+            left->children[left->count + j] = gone->children[j];
+            gone->children[j]->parent = left;
+        }
+        left->count += gone->count;
+        destroyInner(gone);
+        removeFromInner(parent, pos - 1, pos);
+    }
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the BPlusTree class.
+  ---------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef CONCURRENT_H
+#define CONCURRENT_H
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include "persistent.h"
+
+/**
+* A map for many reader threads and the occasional writer, in the style of
+* read-copy-update. The current contents are a PersistentAVLTree published
+* through one atomically swapped pointer:
+*
+*  - readers load the pointer and search that version. They never lock the
+*    tree, never wait for a writer and never see a half-done rotation, since
+*    the nodes they reach are never modified;
+*  - writers take a mutex, so they run one at a time, build the next version by
+*    path copying, and then publish it with a single atomic store;
+*  - a replaced version is freed by its reference count once the last reader
+*    still holding it lets go, so there is no epoch or hazard pointer
+*    bookkeeping and no reader can touch freed memory.
+*
+* snapshot() hands out a whole version, for reading many keys consistently.
+*/
+template <typename Key, typename Value>
+class ConcurrentAVLTree
+{
+public:
+    typedef PersistentAVLTree<Key, Value> Snapshot;
+
+    ConcurrentAVLTree();
+
+    Snapshot snapshot() const;
+    bool find(const Key& key, Value& value) const;
+    bool contains(const Key& key) const;
+    std::size_t size() const;
+
+    void insert_or_assign(const Key& key, const Value& value);
+    void remove(const Key& key);
+
+private:
+    ConcurrentAVLTree(const ConcurrentAVLTree&);
+    ConcurrentAVLTree& operator=(const ConcurrentAVLTree&);
+
+    void publish(const Snapshot& next);
+
+    // published with std::atomic_store, loaded by readers with std::atomic_load
+    std::shared_ptr<const Snapshot> current_;
+    std::mutex writer_;
+};
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the ConcurrentAVLTree class.
+  ------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+ConcurrentAVLTree<Key, Value>::ConcurrentAVLTree() : current_(std::make_shared<const Snapshot>())
+{
+
+}
+
+/**
+* The version current at the time of the call. Later writes do not show up in
+* it, and it stays valid however long it is kept.
+*/
+template<typename Key, typename Value>
+typename ConcurrentAVLTree<Key, Value>::Snapshot
+ConcurrentAVLTree<Key, Value>::snapshot() const
+{
+    return *std::atomic_load(&current_);
+}
+
+/**
+* Copies the value for key into value and returns true, or returns false if key
+* is not there.
+*/
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::find(const Key& key, Value& value) const
+{
+    std::shared_ptr<const Snapshot> tree = std::atomic_load(&current_);
+    typename Snapshot::iterator it = tree->find(key);
+    if (it == tree->end()) return false;
+    value = it->second;
+    return true;
+}
+
+template<typename Key, typename Value>
+bool ConcurrentAVLTree<Key, Value>::contains(const Key& key) const
+{
+    std::shared_ptr<const Snapshot> tree = std::atomic_load(&current_);
+    return tree->find(key) != tree->end();
+}
+
+template<typename Key, typename Value>
+std::size_t ConcurrentAVLTree<Key, Value>::size() const
+{
+    return std::atomic_load(&current_)->size();
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::insert_or_assign(const Key& key, const Value& value)
+{
+    std::lock_guard<std::mutex> lock(writer_);
+    publish(current_->insert_or_assign(key, value));
+}
+
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::remove(const Key& key)
+{
+    std::lock_guard<std::mutex> lock(writer_);
+    publish(current_->remove(key));
+}
+
+/**
+* Called with the writer lock held. Writers are the only ones to change
+* current_, so they may read it directly, but the store has to be atomic as
+* readers may be loading it at the same time.
+*/
+template<typename Key, typename Value>
+void ConcurrentAVLTree<Key, Value>::publish(const Snapshot& next)
+{
+    std::atomic_store(&current_, std::make_shared<const Snapshot>(next));
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the ConcurrentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,182 @@
+#ifndef CONFLICT_GRAPH_H
+#define CONFLICT_GRAPH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* An undirected graph on the vertices 0 .. n-1 stored as an adjacency bit
+* matrix: row u is a run of 64-bit words with bit v set when u and v are
+* adjacent. Sets of vertices use the same layout (words() words, bit v for
+* vertex v), so asking whether u has a neighbour in a set is an AND per word,
+* with no per-edge work at all.
+*
+* In the scheduler the vertices are course IDs and an edge means some student
+* takes both courses, so they may not share a time slot.
+*/
+class ConflictGraph
+{
+public:
+    typedef std::uint64_t Word;
+
+    explicit ConflictGraph(std::size_t vertices);
+
+    std::size_t vertices() const;
+    std::size_t words() const;
+
+    void addEdge(std::size_t u, std::size_t v);
+    template<typename ForwardIt> void addClique(ForwardIt first, ForwardIt last);
+
+    bool adjacent(std::size_t u, std::size_t v) const;
+    const Word* neighbours(std::size_t u) const;
+    std::size_t degree(std::size_t u) const;
+    bool hasNeighbourIn(std::size_t u, const Word* set) const;
+
+    // Operations on vertex sets of words() words.
+    static void insert(Word* set, std::size_t v);
+    static void erase(Word* set, std::size_t v);
+    static bool contains(const Word* set, std::size_t v);
+    template<typename Visit> void forEach(const Word* set, Visit visit) const;
+    static int popcount(Word w);
+
+private:
+    std::size_t vertices_;
+    std::size_t words_;
+    std::vector<Word> rows_;   // row u starts at rows_[u * words_]
+};
+
+/*
+  --------------------------------------------------
+  Begin implementations for the ConflictGraph class.
+  --------------------------------------------------
+*/
+
+inline ConflictGraph::ConflictGraph(std::size_t vertices) :
+    vertices_(vertices), words_((vertices + 63) / 64), rows_(vertices * words_, 0)
+{
+
+}
+
+inline std::size_t ConflictGraph::vertices() const
+{
+    return vertices_;
+}
+
+inline std::size_t ConflictGraph::words() const
+{
+    return words_;
+}
+
+/**
+* Adding an edge twice is harmless. Loops (u == v) are ignored.
+*/
+inline void ConflictGraph::addEdge(std::size_t u, std::size_t v)
+{
+    if (u == v) return;
+    insert(&rows_[u * words_], v);
+    insert(&rows_[v * words_], u);
+}
+
+/**
+* Makes every two of the vertices in [first, last) adjacent, e.g. all the
+* courses one student takes.
+*/
+template<typename ForwardIt>
+void ConflictGraph::addClique(ForwardIt first, ForwardIt last)
+{
+    for (ForwardIt u = first; u != last; ++u) {
+        ForwardIt v = u;
+        for (++v; v != last; ++v) {
+            addEdge(*u, *v);
+        }
+    }
+}
+
+inline bool ConflictGraph::adjacent(std::size_t u, std::size_t v) const
+{
+    return contains(&rows_[u * words_], v);
+}
+
+inline const ConflictGraph::Word* ConflictGraph::neighbours(std::size_t u) const
+{
+    return &rows_[u * words_];
+}
+
+inline std::size_t ConflictGraph::degree(std::size_t u) const
+{
+    const Word* row = neighbours(u);
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < words_; i++) {
+        count += popcount(row[i]);
+    }
+    return count;
+}
+
+/**
+* Whether any neighbour of u is in set. Runs over every word without
+* stopping early; for the few words a row takes that is cheaper than a branch.
+*/
+inline bool ConflictGraph::hasNeighbourIn(std::size_t u, const Word* set) const
+{
+    const Word* row = neighbours(u);
+    Word any = 0;
+    for (std::size_t i = 0; i < words_; i++) {
+        any |= row[i] & set[i];
+    }
+    return any != 0;
+}
+
+inline void ConflictGraph::insert(Word* set, std::size_t v)
+{
+    set[v / 64] |= Word(1) << (v % 64);
+}
+
+inline void ConflictGraph::erase(Word* set, std::size_t v)
+{
+    set[v / 64] &= ~(Word(1) << (v % 64));
+}
+
+inline bool ConflictGraph::contains(const Word* set, std::size_t v)
+{
+    return (set[v / 64] >> (v % 64)) & 1;
+}
+
+/**
+* Calls visit(v) for every vertex v in set, in increasing order. Only the set
+* bits are visited, so sparse sets such as neighbour rows are cheap to walk.
+*/
+template<typename Visit>
+void ConflictGraph::forEach(const Word* set, Visit visit) const
+{
+    for (std::size_t i = 0; i < words_; i++) {
+        for (Word w = set[i]; w != 0; w &= w - 1) {
+#if defined(__GNUC__)
+            std::size_t bit = __builtin_ctzll(w);
+#else
+            std::size_t bit = 0;
+            while (((w >> bit) & 1) == 0) bit++;
+#endif
+            visit(i * 64 + bit);
+        }
+    }
+}
+
+inline int ConflictGraph::popcount(Word w)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(w);
+#else
+    int count = 0;
+    for (; w != 0; w &= w - 1) count++;
+    return count;
+#endif
+}
+
+/*
+  ------------------------------------------------
+  End implementations for the ConflictGraph class.
+  ------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef FROZEN_H
+#define FROZEN_H
+
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+#include "bst.h"
+
+/**
+* An immutable snapshot of a search tree, for maps that are built once and then
+* only read. The items are kept in one sorted array, which is what iteration
+* walks, and a copy of the keys is laid out in Eytzinger (BFS) order: the root
+* at slot 1 and the children of slot k at 2k and 2k+1. A lookup then descends
+* through the array with no pointers to chase, the first few levels share a
+* handful of cache lines, and each step is a compare and a shift, so the next
+* slot is known without a branch and can be prefetched several levels ahead.
+*
+* Built with AVLTree::freeze() or directly from a sorted range of unique keys.
+*/
+template <typename Key, typename Value>
+class FrozenTree
+{
+public:
+    typedef const std::pair<const Key, Value>* const_iterator;
+    typedef const_iterator iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
+
+    FrozenTree();
+    template<typename ForwardIt> FrozenTree(ForwardIt first, ForwardIt last);
+
+    bool empty() const;
+    std::size_t size() const;
+
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_reverse_iterator rbegin() const;
+    const_reverse_iterator rend() const;
+
+    template<typename K> const_iterator find(const K& key) const;
+    template<typename K, typename Compare> const_iterator find(const K& key, Compare less) const;
+    template<typename K> const_iterator lower_bound(const K& key) const;
+    template<typename K, typename Compare> const_iterator lower_bound(const K& key, Compare less) const;
+    template<typename K> const_iterator upper_bound(const K& key) const;
+    template<typename K, typename Compare> const_iterator upper_bound(const K& key, Compare less) const;
+
+private:
+    // keys per cache line, i.e. how many Eytzinger levels one prefetch covers
+    static const std::size_t prefetchStride = sizeof(Key) < 64 ? 64 / sizeof(Key) : 1;
+
+    void layout(std::size_t k, std::size_t& next);
+    std::size_t toSorted(std::size_t k) const;
+
+    std::vector<std::pair<const Key, Value> > items_;   // sorted
+    std::vector<Key> keys_;                            // keys_[k - 1] holds Eytzinger slot k
+    std::vector<unsigned int> order_;                  // order_[k - 1] is slot k's index in items_
+};
+
+/*
+  ----------------------------------------------
+  Begin implementations for the FrozenTree class.
+  ----------------------------------------------
+*/
+
+template<typename Key, typename Value>
+FrozenTree<Key, Value>::FrozenTree()
+{
+
+}
+
+/**
+* Takes a copy of [first, last), which must be sorted by key with no repeats.
+*/
+template<typename Key, typename Value>
+template<typename ForwardIt>
+FrozenTree<Key, Value>::FrozenTree(ForwardIt first, ForwardIt last)
+{
+    items_.reserve(std::distance(first, last));
+    for (; first != last; ++first) {
+        items_.push_back(*first);
+    }
+
+    std::size_t n = items_.size();
+    order_.resize(n);
+    std::size_t next = 0;
+    layout(1, next);
+    keys_.reserve(n);
+    for (std::size_t k = 0; k < n; k++) {
+        keys_.push_back(items_[order_[k]].first);
+    }
+}
+
+/**
+* An in-order walk of the implicit tree hands out the sorted indices in order.
+* The recursion is only O(log n) deep.
+*/
+template<typename Key, typename Value>
+void FrozenTree<Key, Value>::layout(std::size_t k, std::size_t& next)
+{
+    if (k > order_.size()) return;
+    layout(2 * k, next);
+    order_[k - 1] = static_cast<unsigned int>(next++);
+    layout(2 * k + 1, next);
+}
+
+/**
+* After a descent has fallen off the bottom of the array, the answer is the
+* last slot where we went left. Each right turn appended a 1 bit, so dropping
+* the trailing ones and then the final left turn gets back to it. 0 means we
+* never went left and there is no answer.
+*/
+template<typename Key, typename Value>
+std::size_t FrozenTree<Key, Value>::toSorted(std::size_t k) const
+{
+#if defined(__GNUC__)
+    k >>= __builtin_ffsll(~static_cast<unsigned long long>(k));
+#else
+    while (k & 1) k >>= 1;
+    k >>= 1;
+#endif
+    return k == 0 ? items_.size() : order_[k - 1];
+}
+
+template<typename Key, typename Value>
+bool FrozenTree<Key, Value>::empty() const
+{
+    return items_.empty();
+}
+
+template<typename Key, typename Value>
+std::size_t FrozenTree<Key, Value>::size() const
+{
+    return items_.size();
+}
+
+template<typename Key, typename Value>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::begin() const
+{
+    return items_.data();
+}
+
+template<typename Key, typename Value>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::end() const
+{
+    return items_.data() + items_.size();
+}
+
+template<typename Key, typename Value>
+typename FrozenTree<Key, Value>::const_reverse_iterator
+FrozenTree<Key, Value>::rbegin() const
+{
+    return const_reverse_iterator(end());
+}
+
+template<typename Key, typename Value>
+typename FrozenTree<Key, Value>::const_reverse_iterator
+FrozenTree<Key, Value>::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+template<typename Key, typename Value>
+template<typename K>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::find(const K& key) const
+{
+    return find(key, KeyLess());
+}
+
+template<typename Key, typename Value>
+template<typename K, typename Compare>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::find(const K& key, Compare less) const
+{
+    const_iterator it = lower_bound(key, less);
+    if (it != end() && less(key, it->first)) return end();
+    return it;
+}
+
+template<typename Key, typename Value>
+template<typename K>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::lower_bound(const K& key) const
+{
+    return lower_bound(key, KeyLess());
+}
+
+/**
+* The first item whose key is not less than key. Every level is visited, so
+* the loop runs a fixed log2(n) + 1 times whatever the key.
+*/
+template<typename Key, typename Value>
+template<typename K, typename Compare>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::lower_bound(const K& key, Compare less) const
+{
+    const Key* keys = keys_.data();
+    std::size_t n = keys_.size();
+    std::size_t k = 1;
+    while (k <= n) {
+        BST_PREFETCH(keys + prefetchStride * k);
+        k = 2 * k + less(keys[k - 1], key);
+    }
+    return begin() + toSorted(k);
+}
+
+template<typename Key, typename Value>
+template<typename K>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::upper_bound(const K& key) const
+{
+    return upper_bound(key, KeyLess());
+}
+
+/**
+* The first item whose key is greater than key.
+*/
+template<typename Key, typename Value>
+template<typename K, typename Compare>
+typename FrozenTree<Key, Value>::const_iterator
+FrozenTree<Key, Value>::upper_bound(const K& key, Compare less) const
+{
+    const Key* keys = keys_.data();
+    std::size_t n = keys_.size();
+    std::size_t k = 1;
+    while (k <= n) {
+        BST_PREFETCH(keys + prefetchStride * k);
+        k = 2 * k + !less(key, keys[k - 1]);
+    }
+    return begin() + toSorted(k);
+}
+
+/*
+  --------------------------------------------
+  End implementations for the FrozenTree class.
+  --------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+* Maps strings to dense 32-bit IDs, 0, 1, 2, ... in the order they are first
+* seen, and back again. Code that only needs to tell names apart can then carry
+* and compare plain integers, and go back to the strings just for output.
+*
+* Once every name is in, sortIds() renumbers them so that comparing IDs orders
+* them the same way as comparing the names, which lets the IDs stand in for the
+* names as the keys of an ordered map.
+*/
+class StringInterner
+{
+public:
+    typedef unsigned int Id;
+
+    Id intern(const std::string& name);
+    bool contains(const std::string& name) const;
+    Id id(const std::string& name) const;
+    const std::string& name(Id id) const;
+    std::size_t size() const;
+
+    std::vector<Id> sortIds();
+
+private:
+    std::unordered_map<std::string, Id> ids_;
+    std::vector<std::string> names_;   // names_[id] is the name with that id
+};
+
+/*
+  ---------------------------------------------------
+  Begin implementations for the StringInterner class.
+  ---------------------------------------------------
+*/
+
+/**
+* The ID of name, giving it the next free one if it has not been seen before.
+*/
+inline StringInterner::Id StringInterner::intern(const std::string& name)
+{
+    std::pair<std::unordered_map<std::string, Id>::iterator, bool> result =
+        ids_.insert(std::make_pair(name, static_cast<Id>(names_.size())));
+    if (result.second) {
+        names_.push_back(name);
+    }
+    return result.first->second;
+}
+
+inline bool StringInterner::contains(const std::string& name) const
+{
+    return ids_.find(name) != ids_.end();
+}
+
+/**
+* The ID of a name that has already been interned. Throws std::out_of_range
+* if it has not.
+*/
+inline StringInterner::Id StringInterner::id(const std::string& name) const
+{
+    std::unordered_map<std::string, Id>::const_iterator it = ids_.find(name);
+    if (it == ids_.end()) throw std::out_of_range("StringInterner: unknown name");
+    return it->second;
+}
+
+inline const std::string& StringInterner::name(Id id) const
+{
+    return names_[id];
+}
+
+inline std::size_t StringInterner::size() const
+{
+    return names_.size();
+}
+
+/**
+* Renumbers the IDs into the sorted order of the names. Returns the mapping,
+* indexed by old ID, so IDs handed out before can be translated.
+*/
+inline std::vector<StringInterner::Id> StringInterner::sortIds()
+{
+    std::vector<Id> byName(names_.size());
+    for (std::size_t i = 0; i < byName.size(); i++) {
+        byName[i] = static_cast<Id>(i);
+    }
+    std::sort(byName.begin(), byName.end(),
+              [this](Id a, Id b) { return names_[a] < names_[b]; });
+
+    std::vector<Id> remap(names_.size());
+    std::vector<std::string> names(names_.size());
+    for (std::size_t i = 0; i < byName.size(); i++) {
+        remap[byName[i]] = static_cast<Id>(i);
+        names[i].swap(names_[byName[i]]);
+    }
+    names_.swap(names);
+    for (std::size_t i = 0; i < names_.size(); i++) {
+        ids_[names_[i]] = static_cast<Id>(i);
+    }
+    return remap;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for the StringInterner class.
+  -------------------------------------------------
+*/
+
+#endif
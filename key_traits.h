@@ -0,0 +1,390 @@
+#ifndef KEY_TRAITS_H
+#define KEY_TRAITS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#if defined(BST_SIMD_KEYS) && defined(__SSE2__)
+#define KEY_SEARCH_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+* Searching a short sorted run of keys, as found in a node of a wide tree.
+* KeyTraits<Key> provides
+*
+*   static size_t lowerIndex(const Key* keys, size_t n, const Key& key);  // # of keys <  key
+*   static size_t upperIndex(const Key* keys, size_t n, const Key& key);  // # of keys <= key
+*
+* The default is a branch-free halving search using operator<. Defining
+* BST_SIMD_KEYS lets 32- and 64-bit integers, and FixedString keys of up to 8
+* characters, compare a whole vector of keys against the key at once instead:
+* with AVX2 (or SSE2, and SSE4.2 for 64-bit keys) as far as the compiler may use
+* them. SSE2 is always there on x86-64, so -DBST_SIMD_KEYS alone already vectorises
+* 32-bit keys; -msse4.2, -mavx2 or -march=native add the rest. It is off by
+* default because it measured no faster than the scalar search in a B+-tree,
+* where the node loads, not the compares, dominate a lookup.
+*/
+
+/**
+* A string of at most N (<= 16) characters stored inline, so an array of them is
+* one flat block with no pointers. The characters are packed big-endian into
+* 64-bit words and zero padded, so comparing the words as unsigned integers
+* orders the strings exactly as std::string would (for strings without '\0').
+* Meant for short codes like "CSCI104".
+*/
+template <std::size_t N>
+class FixedString
+{
+    static_assert(N > 0 && N <= 16, "FixedString holds 1 to 16 characters");
+
+public:
+    FixedString();
+    FixedString(const char* s);
+    FixedString(const std::string& s);
+
+    std::string str() const;
+    std::size_t size() const;
+    std::uint64_t word(std::size_t i) const;
+
+    bool operator<(const FixedString<N>& rhs) const;
+    bool operator==(const FixedString<N>& rhs) const;
+    bool operator!=(const FixedString<N>& rhs) const;
+
+private:
+    static const std::size_t wordCount = (N + 7) / 8;
+
+    void assign(const char* s, std::size_t len);
+
+    std::uint64_t words_[wordCount];
+};
+
+/**
+* Searches keys that are, or can be viewed as, integers of 32 or 64 bits.
+*/
+template <typename Int>
+struct IntegerKeySearch
+{
+    static std::size_t lowerIndex(const Int* keys, std::size_t n, Int key);
+    static std::size_t upperIndex(const Int* keys, std::size_t n, Int key);
+
+private:
+    // how many keys the vector compare looks at in one go, 0 if it cannot
+#if defined(KEY_SEARCH_SIMD) && defined(__SSE4_2__)
+    static const std::size_t window = sizeof(Int) == 4 ? 16 : 8;
+#elif defined(KEY_SEARCH_SIMD)
+    static const std::size_t window = sizeof(Int) == 4 ? 16 : 0;
+#else
+    static const std::size_t window = 0;
+#endif
+
+    template<bool OrEqual> static std::size_t countBelow(const Int* keys, std::size_t n, Int key);
+    template<bool OrEqual> static std::size_t countWindow(const Int* keys, Int key);
+};
+
+/**
+* The fallback for any ordered key.
+*/
+template <typename Key>
+struct ScalarKeyTraits
+{
+    static std::size_t lowerIndex(const Key* keys, std::size_t n, const Key& key);
+    static std::size_t upperIndex(const Key* keys, std::size_t n, const Key& key);
+};
+
+template <typename Int>
+struct IntegerKeyTraits
+{
+    static std::size_t lowerIndex(const Int* keys, std::size_t n, const Int& key)
+    { return IntegerKeySearch<Int>::lowerIndex(keys, n, key); }
+    static std::size_t upperIndex(const Int* keys, std::size_t n, const Int& key)
+    { return IntegerKeySearch<Int>::upperIndex(keys, n, key); }
+};
+
+template <typename Key>
+struct KeyTraits :
+    std::conditional<std::is_integral<Key>::value && !std::is_same<Key, bool>::value
+                         && (sizeof(Key) == 4 || sizeof(Key) == 8),
+                     IntegerKeyTraits<Key>, ScalarKeyTraits<Key> >::type
+{
+};
+
+/**
+* A FixedString of up to 8 characters is a single word, so an array of them
+* is searched as an array of unsigned 64-bit integers.
+*/
+template <std::size_t N>
+struct FixedWordKeyTraits
+{
+    static std::size_t lowerIndex(const FixedString<N>* keys, std::size_t n, const FixedString<N>& key)
+    { return IntegerKeySearch<std::uint64_t>::lowerIndex(reinterpret_cast<const std::uint64_t*>(keys), n, key.word(0)); }
+    static std::size_t upperIndex(const FixedString<N>* keys, std::size_t n, const FixedString<N>& key)
+    { return IntegerKeySearch<std::uint64_t>::upperIndex(reinterpret_cast<const std::uint64_t*>(keys), n, key.word(0)); }
+};
+
+template <std::size_t N>
+struct KeyTraits<FixedString<N> > :
+    std::conditional<(N <= 8), FixedWordKeyTraits<N>, ScalarKeyTraits<FixedString<N> > >::type
+{
+};
+
+/*
+  -----------------------------------------------
+  Begin implementations for the FixedString class.
+  -----------------------------------------------
+*/
+
+template<std::size_t N>
+FixedString<N>::FixedString()
+{
+    for (std::size_t i = 0; i < wordCount; i++) words_[i] = 0;
+}
+
+template<std::size_t N>
+FixedString<N>::FixedString(const char* s)
+{
+    std::size_t len = 0;
+    while (s[len] != '\0') len++;
+    assign(s, len);
+}
+
+template<std::size_t N>
+FixedString<N>::FixedString(const std::string& s)
+{
+    assign(s.data(), s.size());
+}
+
+/**
+* Packs the characters in, first character in the most significant byte.
+* Throws std::length_error if there are more than N of them.
+*/
+template<std::size_t N>
+void FixedString<N>::assign(const char* s, std::size_t len)
+{
+    if (len > N) throw std::length_error("FixedString: string is too long");
+    for (std::size_t i = 0; i < wordCount; i++) words_[i] = 0;
+    for (std::size_t i = 0; i < len; i++) {
+        std::uint64_t c = static_cast<unsigned char>(s[i]);
+        words_[i / 8] |= c << (8 * (7 - i % 8));
+    }
+}
+
+template<std::size_t N>
+std::string FixedString<N>::str() const
+{
+    std::string s;
+    for (std::size_t i = 0; i < N; i++) {
+        char c = static_cast<char>(words_[i / 8] >> (8 * (7 - i % 8)));
+        if (c == '\0') break;
+        s.push_back(c);
+    }
+    return s;
+}
+
+template<std::size_t N>
+std::size_t FixedString<N>::size() const
+{
+    return str().size();
+}
+
+template<std::size_t N>
+std::uint64_t FixedString<N>::word(std::size_t i) const
+{
+    return words_[i];
+}
+
+template<std::size_t N>
+bool FixedString<N>::operator<(const FixedString<N>& rhs) const
+{
+    for (std::size_t i = 0; i + 1 < wordCount; i++) {
+        if (words_[i] != rhs.words_[i]) return words_[i] < rhs.words_[i];
+    }
+    return words_[wordCount - 1] < rhs.words_[wordCount - 1];
+}
+
+template<std::size_t N>
+bool FixedString<N>::operator==(const FixedString<N>& rhs) const
+{
+    for (std::size_t i = 0; i < wordCount; i++) {
+        if (words_[i] != rhs.words_[i]) return false;
+    }
+    return true;
+}
+
+template<std::size_t N>
+bool FixedString<N>::operator!=(const FixedString<N>& rhs) const
+{
+    return !(*this == rhs);
+}
+
+template<std::size_t N>
+std::ostream& operator<<(std::ostream& os, const FixedString<N>& s)
+{
+    return os << s.str();
+}
+
+/*
+  ---------------------------------------------
+  End implementations for the FixedString class.
+  ---------------------------------------------
+*/
+
+/*
+  -----------------------------------------------------
+  Begin implementations for the key search kernels.
+  -----------------------------------------------------
+*/
+
+/**
+* Halves the range without branching on the comparison.
+*/
+template<typename Key>
+std::size_t ScalarKeyTraits<Key>::lowerIndex(const Key* keys, std::size_t n, const Key& key)
+{
+    if (n == 0) return 0;
+    const Key* base = keys;
+    while (n > 1) {
+        std::size_t half = n / 2;
+        base = base[half] < key ? base + half : base;
+        n -= half;
+    }
+    return (base - keys) + (*base < key);
+}
+
+template<typename Key>
+std::size_t ScalarKeyTraits<Key>::upperIndex(const Key* keys, std::size_t n, const Key& key)
+{
+    if (n == 0) return 0;
+    const Key* base = keys;
+    while (n > 1) {
+        std::size_t half = n / 2;
+        base = key < base[half] ? base : base + half;
+        n -= half;
+    }
+    return (base - keys) + !(key < *base);
+}
+
+template<typename Int>
+std::size_t IntegerKeySearch<Int>::lowerIndex(const Int* keys, std::size_t n, Int key)
+{
+    return countBelow<false>(keys, n, key);
+}
+
+template<typename Int>
+std::size_t IntegerKeySearch<Int>::upperIndex(const Int* keys, std::size_t n, Int key)
+{
+    return countBelow<true>(keys, n, key);
+}
+
+/**
+* Counts the keys below key (or not above it, with OrEqual). Halving narrows the
+* answer down to a window of a few vectors without branching on the keys; then
+* every key in the window is compared at once and the hits added up. The keys
+* before the window are all below key and the keys after it are not, so the
+* window may be slid back to stay inside the array.
+*/
+template<typename Int>
+template<bool OrEqual>
+std::size_t IntegerKeySearch<Int>::countBelow(const Int* keys, std::size_t n, Int key)
+{
+    if (window == 0 || n < window) {
+        return OrEqual ? ScalarKeyTraits<Int>::upperIndex(keys, n, key)
+                       : ScalarKeyTraits<Int>::lowerIndex(keys, n, key);
+    }
+    const Int* base = keys;
+    std::size_t len = n;
+    while (len > window) {
+        std::size_t half = len / 2;
+        bool below = OrEqual ? !(key < base[half]) : base[half] < key;
+        base = below ? base + half : base;
+        len -= half;
+    }
+    std::size_t start = base - keys;
+    if (start > n - window) start = n - window;
+    return start + countWindow<OrEqual>(keys + start, key);
+}
+
+/**
+* Counts the keys below key among the window keys from keys onwards. Each compare
+* leaves -1 in the lanes it hits, so subtracting the results keeps a running
+* count per lane and only the final sum leaves the vector unit. The hardware
+* only compares signed integers, so unsigned keys are shifted into signed range
+* by flipping their top bit.
+*/
+template<typename Int>
+template<bool OrEqual>
+std::size_t IntegerKeySearch<Int>::countWindow(const Int* keys, Int key)
+{
+    // lanes hit: keys above key with OrEqual, keys below it otherwise
+    std::size_t hits = 0;
+#if defined(KEY_SEARCH_SIMD)
+    const bool flip = !std::is_signed<Int>::value;
+    if (sizeof(Int) == 4) {
+        const int topBit = static_cast<int>(0x80000000u);
+        int lanes[8];
+#if defined(__AVX2__)
+        const __m256i bias = _mm256_set1_epi32(flip ? topBit : 0);
+        const __m256i k = _mm256_xor_si256(_mm256_set1_epi32(static_cast<int>(key)), bias);
+        __m256i sum = _mm256_setzero_si256();
+        for (std::size_t i = 0; i < window; i += 8) {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+            sum = _mm256_sub_epi32(sum, OrEqual ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        hits = lanes[0] + lanes[1] + lanes[2] + lanes[3] + lanes[4] + lanes[5] + lanes[6] + lanes[7];
+#else
+        const __m128i bias = _mm_set1_epi32(flip ? topBit : 0);
+        const __m128i k = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(key)), bias);
+        __m128i sum = _mm_setzero_si128();
+        for (std::size_t i = 0; i < window; i += 4) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+            sum = _mm_sub_epi32(sum, OrEqual ? _mm_cmpgt_epi32(v, k) : _mm_cmpgt_epi32(k, v));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+        hits = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+    }
+#if defined(__SSE4_2__)
+    else {
+        const long long topBit = static_cast<long long>(0x8000000000000000ull);
+        long long lanes[4];
+#if defined(__AVX2__)
+        const __m256i bias = _mm256_set1_epi64x(flip ? topBit : 0);
+        const __m256i k = _mm256_xor_si256(_mm256_set1_epi64x(static_cast<long long>(key)), bias);
+        __m256i sum = _mm256_setzero_si256();
+        for (std::size_t i = 0; i < window; i += 4) {
+            __m256i v = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)), bias);
+            sum = _mm256_sub_epi64(sum, OrEqual ? _mm256_cmpgt_epi64(v, k) : _mm256_cmpgt_epi64(k, v));
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), sum);
+        hits = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#else
+        const __m128i bias = _mm_set1_epi64x(flip ? topBit : 0);
+        const __m128i k = _mm_xor_si128(_mm_set1_epi64x(static_cast<long long>(key)), bias);
+        __m128i sum = _mm_setzero_si128();
+        for (std::size_t i = 0; i < window; i += 2) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(keys + i)), bias);
+            sum = _mm_sub_epi64(sum, OrEqual ? _mm_cmpgt_epi64(v, k) : _mm_cmpgt_epi64(k, v));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+        hits = lanes[0] + lanes[1];
+#endif
+    }
+#endif
+#else
+    (void)keys;
+    (void)key;
+#endif
+    return OrEqual ? window - hits : hits;
+}
+
+/*
+  ---------------------------------------------------
+  End implementations for the key search kernels.
+  ---------------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef NODE_ALLOC_H
+#define NODE_ALLOC_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+* Allocation policies for the nodes of a search tree. A policy is constructed
+* with the size and alignment of the nodes it will hand out and provides:
+*
+*   void* allocate();          storage for one node
+*   void deallocate(void* p);  return storage from allocate()
+*   void reserve(size_t n);    make room for n live nodes up front
+*   void reset();              forget every node handed out so far
+*   void trim();               after reset(), give spare storage back
+*
+* bulkRelease tells the tree whether reset() alone gives all of the memory back,
+* in which case clear() can skip visiting nodes whose destructors do nothing.
+* The trees reset() their allocator when they are about to be refilled, and
+* reset() then trim() on clear(), so an emptied tree does not hold on to the
+* storage of its largest size.
+*/
+
+/**
+* One operator new/delete per node. reset() cannot release anything on its own,
+* so the tree always frees node by node.
+*/
+class HeapAlloc
+{
+public:
+    static const bool bulkRelease = false;
+
+    HeapAlloc(std::size_t nodeSize, std::size_t nodeAlign);
+
+    void* allocate();
+    void deallocate(void* p);
+    void reserve(std::size_t n);
+    void reset();
+    void trim();
+
+private:
+    std::size_t nodeSize_;
+};
+
+/**
+* A per-tree slab allocator. Nodes are carved out of large slabs in address order
+* and freed nodes are kept on an intrusive free list for the next allocate(), so
+* insert/remove churn never reaches malloc once the tree has warmed up. reset() is
+* O(1): it drops the free list and rewinds to the first slab, keeping the slabs
+* for reuse. trim() then returns every slab but the first to the system.
+*/
+class NodeArena
+{
+public:
+    static const bool bulkRelease = true;
+
+    NodeArena(std::size_t nodeSize, std::size_t nodeAlign);
+    NodeArena(NodeArena&& other);
+    ~NodeArena();
+    NodeArena& operator=(NodeArena&& other);
+
+    void* allocate();
+    void deallocate(void* p);
+    void reserve(std::size_t n);
+    void reset();
+    void trim();
+
+private:
+    NodeArena(const NodeArena&);
+    NodeArena& operator=(const NodeArena&);
+
+    void addSlab(std::size_t slots);
+
+    struct FreeSlot { FreeSlot* next; };
+
+    std::size_t slotSize_;
+    // each slab with the number of slots it holds
+    std::vector<std::pair<char*, std::size_t> > slabs_;
+    std::size_t currSlab_;   // slab we are currently bumping through
+    std::size_t used_;       // slots handed out from slabs_[currSlab_]
+    std::size_t capacity_;   // total slots over all slabs
+    FreeSlot* free_;
+};
+
+/*
+  -------------------------------------------
+  Begin implementations for the HeapAlloc class.
+  -------------------------------------------
+*/
+
+inline HeapAlloc::HeapAlloc(std::size_t nodeSize, std::size_t) : nodeSize_(nodeSize)
+{
+
+}
+
+inline void* HeapAlloc::allocate()
+{
+    return ::operator new(nodeSize_);
+}
+
+inline void HeapAlloc::deallocate(void* p)
+{
+    ::operator delete(p);
+}
+
+inline void HeapAlloc::reserve(std::size_t)
+{
+
+}
+
+inline void HeapAlloc::reset()
+{
+
+}
+
+inline void HeapAlloc::trim()
+{
+
+}
+
+/*
+  -------------------------------------------
+  Begin implementations for the NodeArena class.
+  -------------------------------------------
+*/
+
+/**
+* Rounds the slot size up to the node's alignment (and to something that can hold
+* a free list link), so slots are packed as tightly as an array of nodes would be.
+*/
+inline NodeArena::NodeArena(std::size_t nodeSize, std::size_t nodeAlign) :
+    slotSize_(0), currSlab_(0), used_(0), capacity_(0), free_(NULL)
+{
+    std::size_t align = nodeAlign < alignof(FreeSlot) ? alignof(FreeSlot) : nodeAlign;
+    std::size_t size = nodeSize < sizeof(FreeSlot) ? sizeof(FreeSlot) : nodeSize;
+    slotSize_ = (size + align - 1) / align * align;
+}
+
+/**
+* Takes over every slab, leaving other empty but still usable.
+*/
+inline NodeArena::NodeArena(NodeArena&& other) :
+    slotSize_(other.slotSize_), slabs_(std::move(other.slabs_)), currSlab_(other.currSlab_),
+    used_(other.used_), capacity_(other.capacity_), free_(other.free_)
+{
+    other.slabs_.clear();
+    other.currSlab_ = 0;
+    other.used_ = 0;
+    other.capacity_ = 0;
+    other.free_ = NULL;
+}
+
+inline NodeArena::~NodeArena()
+{
+    for (std::size_t i = 0; i < slabs_.size(); i++) {
+        ::operator delete(slabs_[i].first);
+    }
+}
+
+/**
+* Frees this arena's slabs and takes over other's. Only valid once nothing
+* allocated from this arena is still in use.
+*/
+inline NodeArena& NodeArena::operator=(NodeArena&& other)
+{
+    if (this != &other) {
+        for (std::size_t i = 0; i < slabs_.size(); i++) {
+            ::operator delete(slabs_[i].first);
+        }
+        slotSize_ = other.slotSize_;
+        slabs_ = std::move(other.slabs_);
+        currSlab_ = other.currSlab_;
+        used_ = other.used_;
+        capacity_ = other.capacity_;
+        free_ = other.free_;
+        other.slabs_.clear();
+        other.currSlab_ = 0;
+        other.used_ = 0;
+        other.capacity_ = 0;
+        other.free_ = NULL;
+    }
+    return *this;
+}
+
+inline void* NodeArena::allocate()
+{
+    if (free_ != NULL) {
+        FreeSlot* slot = free_;
+        free_ = slot->next;
+        return slot;
+    }
+
+    // move on to the next slab, growing geometrically when we run out
+    while (currSlab_ == slabs_.size() || used_ == slabs_[currSlab_].second) {
+        if (currSlab_ + 1 < slabs_.size()) {
+            currSlab_++;
+            used_ = 0;
+        }
+        else {
+            std::size_t slots = capacity_ < 64 ? 64 : capacity_;
+            if (slots > 8192) slots = 8192;
+            addSlab(slots);
+        }
+    }
+    return slabs_[currSlab_].first + slotSize_ * used_++;
+}
+
+inline void NodeArena::deallocate(void* p)
+{
+    FreeSlot* slot = static_cast<FreeSlot*>(p);
+    slot->next = free_;
+    free_ = slot;
+}
+
+/**
+* Makes sure at least n slots exist in total, using a single slab for the shortfall.
+*/
+inline void NodeArena::reserve(std::size_t n)
+{
+    if (n > capacity_) addSlab(n - capacity_);
+}
+
+inline void NodeArena::reset()
+{
+    free_ = NULL;
+    currSlab_ = 0;
+    used_ = 0;
+}
+
+/**
+* Frees every slab after the first, so a cleared tree keeps one slab's worth of
+* slots to refill into rather than all it ever grew to. Only valid straight
+* after reset(), while no slot is handed out.
+*/
+inline void NodeArena::trim()
+{
+    for (std::size_t i = 1; i < slabs_.size(); i++) {
+        ::operator delete(slabs_[i].first);
+    }
+    if (slabs_.size() > 1) slabs_.resize(1);
+    capacity_ = slabs_.empty() ? 0 : slabs_[0].second;
+}
+
+/**
+* Appends a slab. If the current slab is the last one and is exhausted (or there
+* are no slabs yet) the new slab becomes the current one.
+*/
+inline void NodeArena::addSlab(std::size_t slots)
+{
+    char* slab = static_cast<char*>(::operator new(slotSize_ * slots));
+    bool wasFull = slabs_.empty() || (currSlab_ + 1 == slabs_.size() && used_ == slabs_[currSlab_].second);
+    slabs_.push_back(std::make_pair(slab, slots));
+    capacity_ += slots;
+    if (wasFull) {
+        currSlab_ = slabs_.size() - 1;
+        used_ = 0;
+    }
+}
+
+#endif
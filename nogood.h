@@ -0,0 +1,154 @@
+#ifndef NOGOOD_H
+#define NOGOOD_H
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+* A bounded store of nogoods: sets of assignments (variable = value) that a
+* search has proven cannot all hold in a solution. Once a nogood is known, a
+* later branch that would complete it can be cut without searching it again.
+*
+* The store holds at most capacity nogoods of at most maxLength literals and
+* overwrites the oldest when full, so its memory is fixed up front and adding
+* never allocates. Each literal keeps a few watches, the most recent nogoods
+* that contain it, so asking whether a value would complete a nogood only looks
+* at those. A nogood that has been overwritten is recognised by its stamp and
+* skipped, and nothing ever has to be unlinked.
+*
+* Variables are 0 .. variables-1 and values 0 .. values-1.
+*/
+class NogoodCache
+{
+public:
+    typedef std::pair<unsigned int, int> Literal;   // (variable, value)
+
+    NogoodCache(std::size_t variables, int values, std::size_t capacity, std::size_t maxLength);
+
+    std::size_t capacity() const;
+    std::size_t maxLength() const;
+
+    bool add(const Literal* literals, std::size_t length);
+    template<typename Assigned>
+    const Literal* completed(unsigned int variable, int value, Assigned assigned, std::size_t& length) const;
+
+private:
+    struct Watch
+    {
+        std::size_t nogood;
+        unsigned int stamp;   // 0 for an empty watch
+    };
+
+    static const std::size_t watchesPerLiteral = 4;
+
+    std::size_t values_;
+    std::size_t capacity_;
+    std::size_t maxLength_;
+    std::size_t next_;                   // the slot the next nogood goes in
+    std::vector<Literal> literals_;      // nogood k starts at literals_[k * maxLength_]
+    std::vector<std::size_t> lengths_;
+    std::vector<unsigned int> stamps_;   // bumped each time slot k is reused
+    std::vector<Watch> watches_;         // watchesPerLiteral for each (variable, value)
+    std::vector<unsigned char> nextWatch_;
+};
+
+/*
+  ------------------------------------------------
+  Begin implementations for the NogoodCache class.
+  ------------------------------------------------
+*/
+
+/**
+* A capacity of 0 makes a cache that never keeps anything.
+*/
+inline NogoodCache::NogoodCache(std::size_t variables, int values, std::size_t capacity, std::size_t maxLength) :
+    values_(values), capacity_(capacity), maxLength_(maxLength), next_(0),
+    literals_(capacity * maxLength), lengths_(capacity, 0), stamps_(capacity, 0),
+    watches_(capacity == 0 ? 0 : variables * values * watchesPerLiteral),
+    nextWatch_(capacity == 0 ? 0 : variables * values, 0)
+{
+    for (std::size_t i = 0; i < watches_.size(); i++) {
+        watches_[i].nogood = 0;
+        watches_[i].stamp = 0;
+    }
+}
+
+inline std::size_t NogoodCache::capacity() const
+{
+    return capacity_;
+}
+
+inline std::size_t NogoodCache::maxLength() const
+{
+    return maxLength_;
+}
+
+/**
+* Keeps the nogood, in place of the oldest one if the cache is full. Returns
+* false without keeping it if it is empty or longer than maxLength(); an empty
+* nogood means there is no solution at all, which the caller already knows.
+*/
+inline bool NogoodCache::add(const Literal* literals, std::size_t length)
+{
+    if (capacity_ == 0 || length == 0 || length > maxLength_) return false;
+
+    std::size_t k = next_;
+    next_ = (next_ + 1) % capacity_;
+    stamps_[k]++;
+    if (stamps_[k] == 0) stamps_[k] = 1;   // 0 marks an empty watch
+    lengths_[k] = length;
+    for (std::size_t j = 0; j < length; j++) {
+        literals_[k * maxLength_ + j] = literals[j];
+
+        std::size_t literal = literals[j].first * values_ + literals[j].second;
+        Watch& watch = watches_[literal * watchesPerLiteral + nextWatch_[literal]];
+        nextWatch_[literal] = (nextWatch_[literal] + 1) % watchesPerLiteral;
+        watch.nogood = k;
+        watch.stamp = stamps_[k];
+    }
+    return true;
+}
+
+/**
+* Whether setting variable to value would complete a watched nogood, given
+* assigned(v), the current value of each variable v (anything outside
+* 0 .. values-1 for unassigned ones). If so, returns that nogood's literals and
+* puts its length in length; otherwise returns NULL.
+*/
+template<typename Assigned>
+const NogoodCache::Literal* NogoodCache::completed(unsigned int variable, int value, Assigned assigned,
+                                                   std::size_t& length) const
+{
+    if (capacity_ == 0) return NULL;
+
+    std::size_t literal = variable * values_ + value;
+    for (std::size_t w = 0; w < watchesPerLiteral; w++) {
+        const Watch& watch = watches_[literal * watchesPerLiteral + w];
+        if (watch.stamp == 0 || stamps_[watch.nogood] != watch.stamp) continue;
+
+        const Literal* nogood = &literals_[watch.nogood * maxLength_];
+        std::size_t j = 0;
+        for (; j < lengths_[watch.nogood]; j++) {
+            if (nogood[j].first == variable) {
+                if (nogood[j].second != value) break;
+            }
+            else if (assigned(nogood[j].first) != nogood[j].second) {
+                break;
+            }
+        }
+        if (j == lengths_[watch.nogood]) {
+            length = j;
+            return nogood;
+        }
+    }
+    return NULL;
+}
+
+/*
+  ----------------------------------------------
+  End implementations for the NogoodCache class.
+  ----------------------------------------------
+*/
+
+#endif
@@ -0,0 +1,437 @@
+#ifndef PERSISTENT_H
+#define PERSISTENT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+/**
+* A persistent AVL tree: every version stays valid forever. Nodes are immutable
+* and shared between versions through reference counts, and an update copies
+* only the O(log n) nodes on the path to the key, so insert_or_assign() and
+* remove() return a new version and leave this one exactly as it was. Copying a
+* tree is O(1), which makes it a snapshot. Dropping a version frees only the
+* nodes no other version still uses.
+*
+* Because no node ever changes after it is built, versions can be read from
+* any number of threads at once (the reference counts are atomic), and a search
+* that needs to go back to an earlier state just keeps the earlier version
+* around instead of undoing its changes.
+*/
+template <typename Key, typename Value>
+class PersistentAVLTree
+{
+private:
+    struct Node;
+    typedef std::shared_ptr<const Node> NodePtr;
+
+public:
+    class iterator
+    {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef std::pair<const Key, Value> value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const value_type* pointer;
+        typedef const value_type& reference;
+
+        iterator();
+
+        reference operator*() const;
+        pointer operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+        iterator operator++(int);
+
+    private:
+        friend class PersistentAVLTree<Key, Value>;
+
+        void pushLeft(const Node* node);
+
+        // an AVL tree of 2^32 nodes is under 47 levels tall
+        static const int maxDepth = 48;
+
+        // the nodes still to visit, the current one on top
+        const Node* path_[maxDepth];
+        int depth_;
+    };
+    typedef iterator const_iterator;
+
+    PersistentAVLTree();
+
+    bool empty() const;
+    std::size_t size() const;
+    bool isValid() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+
+    PersistentAVLTree insert_or_assign(const Key& key, const Value& value) const;
+    PersistentAVLTree remove(const Key& key) const;
+
+private:
+    struct Node
+    {
+        Node(const Key& key, const Value& value, const NodePtr& left, const NodePtr& right);
+
+        std::pair<const Key, Value> item;
+        NodePtr left;
+        NodePtr right;
+        std::size_t size;
+        signed char height;
+    };
+
+    explicit PersistentAVLTree(const NodePtr& root);
+
+    static int height(const NodePtr& node);
+    static std::size_t size(const NodePtr& node);
+    static NodePtr make(const Key& key, const Value& value, const NodePtr& left, const NodePtr& right);
+    static NodePtr balance(const Key& key, const Value& value, const NodePtr& left, const NodePtr& right);
+    static NodePtr insertAt(const NodePtr& node, const Key& key, const Value& value);
+    static NodePtr removeAt(const NodePtr& node, const Key& key, bool& found);
+    static NodePtr removeSmallest(const NodePtr& node, const Node*& smallest);
+    static bool valid(const NodePtr& node, const Key* lo, const Key* hi);
+
+    NodePtr root_;
+};
+
+/*
+  -----------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::Node class.
+  -----------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+PersistentAVLTree<Key, Value>::Node::Node(const Key& key, const Value& value,
+                                          const NodePtr& left, const NodePtr& right) :
+    item(key, value), left(left), right(right),
+    size(1 + PersistentAVLTree::size(left) + PersistentAVLTree::size(right)),
+    height(static_cast<signed char>(1 + std::max(PersistentAVLTree::height(left),
+                                                 PersistentAVLTree::height(right))))
+{
+
+}
+
+/*
+  ---------------------------------------------------------------
+  Begin implementations for the PersistentAVLTree::iterator class.
+  ---------------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+PersistentAVLTree<Key, Value>::iterator::iterator() : depth_(0)
+{
+
+}
+
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::iterator::reference
+PersistentAVLTree<Key, Value>::iterator::operator*() const
+{
+    return path_[depth_ - 1]->item;
+}
+
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::iterator::pointer
+PersistentAVLTree<Key, Value>::iterator::operator->() const
+{
+    return &(path_[depth_ - 1]->item);
+}
+
+/**
+* Two iterators are equal when they are on the same node, or both at the end.
+*/
+template<typename Key, typename Value>
+bool PersistentAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    if (depth_ == 0 || rhs.depth_ == 0) return depth_ == rhs.depth_;
+    return path_[depth_ - 1] == rhs.path_[rhs.depth_ - 1];
+}
+
+template<typename Key, typename Value>
+bool PersistentAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Nodes have no parent pointers (a node can sit in many versions at once), so
+* the iterator keeps the nodes it still has to come back to.
+*/
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::iterator&
+PersistentAVLTree<Key, Value>::iterator::operator++()
+{
+    const Node* node = path_[--depth_];
+    pushLeft(node->right.get());
+    return *this;
+}
+
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::iterator::operator++(int)
+{
+    iterator old = *this;
+    ++(*this);
+    return old;
+}
+
+template<typename Key, typename Value>
+void PersistentAVLTree<Key, Value>::iterator::pushLeft(const Node* node)
+{
+    for (; node != NULL; node = node->left.get()) {
+        path_[depth_++] = node;
+    }
+}
+
+/*
+  ------------------------------------------------------
+  Begin implementations for the PersistentAVLTree class.
+  ------------------------------------------------------
+*/
+
+template<typename Key, typename Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree()
+{
+
+}
+
+template<typename Key, typename Value>
+PersistentAVLTree<Key, Value>::PersistentAVLTree(const NodePtr& root) : root_(root)
+{
+
+}
+
+template<typename Key, typename Value>
+bool PersistentAVLTree<Key, Value>::empty() const
+{
+    return root_ == NULL;
+}
+
+template<typename Key, typename Value>
+std::size_t PersistentAVLTree<Key, Value>::size() const
+{
+    return size(root_);
+}
+
+/**
+* Checks every node: keys in order, stored heights and sizes right, and the
+* heights of each node's subtrees at most one apart. Walks the whole version,
+* so it is meant for tests.
+*/
+template<typename Key, typename Value>
+bool PersistentAVLTree<Key, Value>::isValid() const
+{
+    return valid(root_, NULL, NULL);
+}
+
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::begin() const
+{
+    iterator it;
+    it.pushLeft(root_.get());
+    return it;
+}
+
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::end() const
+{
+    return iterator();
+}
+
+/**
+* Walks down to key, keeping the nodes where we went left: those are exactly
+* the ones an in-order walk from key still has to visit.
+*/
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::iterator
+PersistentAVLTree<Key, Value>::find(const Key& key) const
+{
+    iterator it;
+    const Node* node = root_.get();
+    while (node != NULL) {
+        if (key < node->item.first) {
+            it.path_[it.depth_++] = node;
+            node = node->left.get();
+        }
+        else if (node->item.first < key) {
+            node = node->right.get();
+        }
+        else {
+            it.path_[it.depth_++] = node;
+            return it;
+        }
+    }
+    return end();
+}
+
+/**
+* A new version with key mapped to value. This version is not changed.
+*/
+template<typename Key, typename Value>
+PersistentAVLTree<Key, Value>
+PersistentAVLTree<Key, Value>::insert_or_assign(const Key& key, const Value& value) const
+{
+    return PersistentAVLTree(insertAt(root_, key, value));
+}
+
+/**
+* A new version without key. If key is not in the tree the new version shares
+* this one's root, and nothing is copied.
+*/
+template<typename Key, typename Value>
+PersistentAVLTree<Key, Value>
+PersistentAVLTree<Key, Value>::remove(const Key& key) const
+{
+    bool found = false;
+    NodePtr root = removeAt(root_, key, found);
+    return found ? PersistentAVLTree(root) : *this;
+}
+
+template<typename Key, typename Value>
+int PersistentAVLTree<Key, Value>::height(const NodePtr& node)
+{
+    return node == NULL ? 0 : node->height;
+}
+
+template<typename Key, typename Value>
+std::size_t PersistentAVLTree<Key, Value>::size(const NodePtr& node)
+{
+    return node == NULL ? 0 : node->size;
+}
+
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::NodePtr
+PersistentAVLTree<Key, Value>::make(const Key& key, const Value& value, const NodePtr& left, const NodePtr& right)
+{
+    return std::make_shared<const Node>(key, value, left, right);
+}
+
+/**
+* Builds a node over two subtrees whose heights differ by at most two, rotating
+* if they differ by two. Rotations build new nodes as well, so the subtrees
+* passed in, which other versions may share, are never touched.
+*/
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::NodePtr
+PersistentAVLTree<Key, Value>::balance(const Key& key, const Value& value, const NodePtr& left, const NodePtr& right)
+{
+    int hl = height(left);
+    int hr = height(right);
+    if (hl > hr + 1) {
+        if (height(left->left) >= height(left->right)) {
+            return make(left->item.first, left->item.second, left->left,
+                        make(key, value, left->right, right));
+        }
+        const NodePtr& lr = left->right;
+        return make(lr->item.first, lr->item.second,
+                    make(left->item.first, left->item.second, left->left, lr->left),
+                    make(key, value, lr->right, right));
+    }
+    if (hr > hl + 1) {
+        if (height(right->right) >= height(right->left)) {
+            return make(right->item.first, right->item.second,
+                        make(key, value, left, right->left), right->right);
+        }
+        const NodePtr& rl = right->left;
+        return make(rl->item.first, rl->item.second,
+                    make(key, value, left, rl->left),
+                    make(right->item.first, right->item.second, rl->right, right->right));
+    }
+    return make(key, value, left, right);
+}
+
+/**
+* The recursion follows one root-to-leaf path, so it is only O(log n) deep.
+*/
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::NodePtr
+PersistentAVLTree<Key, Value>::insertAt(const NodePtr& node, const Key& key, const Value& value)
+{
+    if (node == NULL) {
+        return make(key, value, NodePtr(), NodePtr());
+    }
+    const Key& nodeKey = node->item.first;
+    if (key < nodeKey) {
+        return balance(nodeKey, node->item.second, insertAt(node->left, key, value), node->right);
+    }
+    if (nodeKey < key) {
+        return balance(nodeKey, node->item.second, node->left, insertAt(node->right, key, value));
+    }
+    return make(key, value, node->left, node->right);
+}
+
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::NodePtr
+PersistentAVLTree<Key, Value>::removeAt(const NodePtr& node, const Key& key, bool& found)
+{
+    if (node == NULL) {
+        return node;
+    }
+    const Key& nodeKey = node->item.first;
+    if (key < nodeKey) {
+        NodePtr left = removeAt(node->left, key, found);
+        return found ? balance(nodeKey, node->item.second, left, node->right) : node;
+    }
+    if (nodeKey < key) {
+        NodePtr right = removeAt(node->right, key, found);
+        return found ? balance(nodeKey, node->item.second, node->left, right) : node;
+    }
+
+    found = true;
+    if (node->left == NULL) return node->right;
+    if (node->right == NULL) return node->left;
+    // the successor takes this node's place
+    const Node* successor = NULL;
+    NodePtr right = removeSmallest(node->right, successor);
+    return balance(successor->item.first, successor->item.second, node->left, right);
+}
+
+/**
+* Removes the smallest node of a subtree and hands it back through smallest.
+* The node stays alive as long as the old subtree does.
+*/
+template<typename Key, typename Value>
+typename PersistentAVLTree<Key, Value>::NodePtr
+PersistentAVLTree<Key, Value>::removeSmallest(const NodePtr& node, const Node*& smallest)
+{
+    if (node->left == NULL) {
+        smallest = node.get();
+        return node->right;
+    }
+    NodePtr left = removeSmallest(node->left, smallest);
+    return balance(node->item.first, node->item.second, left, node->right);
+}
+
+/**
+* Checks a subtree whose keys must lie strictly between lo and hi where those
+* are given.
+*/
+template<typename Key, typename Value>
+bool PersistentAVLTree<Key, Value>::valid(const NodePtr& node, const Key* lo, const Key* hi)
+{
+    if (node == NULL) return true;
+    const Key& key = node->item.first;
+    if ((lo != NULL && !(*lo < key)) || (hi != NULL && !(key < *hi))) return false;
+    if (!valid(node->left, lo, &key) || !valid(node->right, &key, hi)) return false;
+    int hl = height(node->left);
+    int hr = height(node->right);
+    return node->height == 1 + std::max(hl, hr) && hl <= hr + 1 && hr <= hl + 1
+        && node->size == 1 + size(node->left) + size(node->right);
+}
+
+/*
+  ----------------------------------------------------
+  End implementations for the PersistentAVLTree class.
+  ----------------------------------------------------
+*/
+
+#endif
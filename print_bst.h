@@ -17,8 +17,8 @@
 // 1 means that it is the root.
 // Returns -1 (not found) if the distance is more than PPBST_MAX_HEIGHT,
 // or -2 if the tree is inconsistent.
-template<typename Key, typename Value>
-int getNodeDepth(BinarySearchTree<Key, Value> const & tree, Node<Key, Value> * root, Node<Key, Value> * node)
+template<typename Key, typename Value, typename Alloc>
+int getNodeDepth(BinarySearchTree<Key, Value, Alloc> const & tree, Node<Key, Value> * root, Node<Key, Value> * node)
 {
 	int dist = 1;
 
@@ -92,8 +92,8 @@ int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
 
     */
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
+template<typename Key, typename Value, typename Alloc>
+void BinarySearchTree<Key, Value, Alloc>::printRoot (Node<Key, Value>* root) const
 {
 	// special case for empty trees:
 	if(root == nullptr)
@@ -130,14 +130,14 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 	std::map<Key, uint8_t> valuePlaceholders;
 
 	uint8_t nextPlaceHolderVal = 1;
-	for(typename BinarySearchTree<Key, Value>::iterator treeIter = this->begin(); treeIter != this->end(); ++treeIter)
+	for(Node<Key, Value>* treeNode = this->getSmallestNode(); treeNode != NULL; treeNode = this->successor(treeNode))
 	{
 
-		if(getNodeDepth(*this, root, treeIter.current_) != -1)
+		if(getNodeDepth(*this, root, treeNode) != -1)
 		{
 			// note; the iterator will traverse in sorted order so values should get the same placeholders between
 			// different calls as long as the tree is the same
-			valuePlaceholders.insert(std::make_pair(treeIter->first, nextPlaceHolderVal++));
+			valuePlaceholders.insert(std::make_pair(treeNode->getKey(), nextPlaceHolderVal++));
 		}
 
 	}
@@ -273,7 +273,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 			std::cout.flags(origCoutState);
 			std::cout << '(' << placeholdersIter->first << ", ";
 
-			typename BinarySearchTree<Key, Value>::iterator elementIter = this->find(placeholdersIter->first);
+			typename BinarySearchTree<Key, Value, Alloc>::const_iterator elementIter = this->find(placeholdersIter->first);
 			if(elementIter == this->end())
 			{
 				std::cout << "<error: lookup failed>";
@@ -1,4 +1,9 @@
 #include "avlbst.h"
+#include "btree.h"
+#include "conflict_graph.h"
+#include "intern.h"
+#include "nogood.h"
+#include "persistent.h"
 #include <vector>
 #include <string>
 #include <cstdlib>
@@ -6,10 +11,147 @@
 #include <map>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <new>
+#include <atomic>
+#include <algorithm>
 using namespace std; 
 
-void backtrack(vector<set<string>*> schedule, vector<string> courses, AVLTree<string, int>& avl, bool& check, int classes, int students, int slots, int x);
-void helper(AVLTree<string,int>::iterator it, int i, int students, vector<set<string>*>& schedule, vector<string>& courses, string course, bool& insert);
+#ifdef SCHEDULER_COUNT_ALLOCS
+// Built as scheduling-stats (make scheduling-stats): every heap allocation
+// bumps this, so --stats can show that the search itself makes none.
+static atomic<unsigned long long> heapAllocations(0);
+
+void* operator new(size_t size) {
+    heapAllocations++;
+    void* p = malloc(size == 0 ? 1 : size);
+    if (p == NULL) throw bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+#endif
+
+// Courses are interned to dense IDs as they are read, numbered in name order,
+// so the search compares and copies integers and the names only come back
+// for output.
+typedef StringInterner::Id CourseId;
+
+// The course -> time slot map. Any tree with the AVLTree interface works here,
+// e.g. BPlusTree<CourseId, int>, and so does PersistentAVLTree<CourseId, int>,
+// which the search extends into a new version instead of undoing its changes.
+typedef AVLTree<CourseId, int> CourseTree;
+
+// The courses in each time slot, as a bit set per slot over the course IDs.
+typedef vector<ConflictGraph::Word> SlotSets;
+
+// Which course the search places next (--order=...).
+enum CourseOrder {
+    FILE_ORDER,   // as they first appear in the input
+    MAX_DEGREE,   // most conflicting courses first, fixed before the search
+    MRV,          // fewest open slots left (minimum remaining values), ties in file order
+    DSATUR        // most distinct slots taken by its conflicts, ties to the most unplaced conflicts
+};
+
+// In which order the open slots for a course are tried (--values=...).
+enum SlotOrder {
+    ASCENDING,            // 1, 2, 3, ...
+    LEAST_CONSTRAINING    // the slot that closes the fewest options for unplaced conflicting courses first
+};
+
+// What the search infers after each placement (--propagate=...).
+enum Propagation {
+    NO_PROPAGATION,     // a clash is only found when a slot is tried
+    FORWARD_CHECKING,   // the slot is struck from the domains of unplaced conflicting courses
+    ARC_CONSISTENCY     // as forward checking, then AC-3: a course left with one slot strikes it from its conflicts in turn
+};
+
+// Nogoods longer than this are not worth keeping: they rarely come up again.
+static const size_t maxNogoodLength = 16;
+
+// One search: the problem, which never changes, and the slots taken so far,
+// which the search updates in place and restores on the way back. Everything is
+// sized before the search starts, so the recursion itself never allocates.
+struct Search {
+    Search(const ConflictGraph& conflicts, const vector<CourseId>& courses, const StringInterner& names,
+           int classes, int slots, CourseOrder courseOrder, SlotOrder slotOrder, Propagation propagation,
+           bool backjumping, size_t nogoodCapacity);
+
+    const ConflictGraph& conflicts;
+    const StringInterner& names;
+    const int classes;
+    const int slots;
+    const CourseOrder courseOrder;
+    const SlotOrder slotOrder;
+    const Propagation propagation;
+    const bool backjumping;       // conflict-directed backjumping (--backjump, or --nogoods=N)
+    const bool counting;          // whether the heuristics need blocked and saturation
+    const size_t slotWords;       // words in one domain
+    vector<CourseId> order;       // file order, or by degree for MAX_DEGREE
+
+    SlotSets occupied;
+    SlotSets unplaced;            // the courses not placed yet, one bit set
+    vector<int> blocked;          // blocked[c * slots + i - 1]: conflicts of c placed in slot i
+    vector<int> saturation;       // how many slots c has blocked
+    vector<pair<int, int> > tries;   // (score, slot) for each level, slots entries each
+    bool check;                   // a schedule has been found and printed
+    unsigned long long nodes;     // assignments tried
+
+    // With propagation: the slots still open to each course, as a bit set of
+    // slotWords words per course with bit i - 1 for slot i, and the trail of
+    // (course, slot) pairs struck out, so a level can put back exactly its own.
+    SlotSets domains;
+    vector<pair<CourseId, int> > trail;
+    size_t trailSize;
+    vector<pair<CourseId, int> > pending;   // AC-3: courses down to one slot, still to pass it on
+
+    // With backjumping: for each level, the set of placed courses whose slots
+    // explain every failure there so far (conflicts.words() words each). When a
+    // level runs out of slots it hands its set back up, and the levels between
+    // whose course is not in it are skipped, since no other slot for them can
+    // help. With propagation, the placed courses that forced each struck slot
+    // out are kept as well, so a wiped-out domain can be explained.
+    vector<int> slotOf;           // the slot of each placed course, 0 if unplaced
+    vector<int> placedAt;         // how many courses were placed before each placed course
+    int placed;
+    SlotSets conflictSets;        // level x at conflictSets[x * conflicts.words()]
+    SlotSets reasons;             // reasons[(c * slots + i - 1) * conflicts.words()]: why c lost slot i
+    SlotSets because;             // scratch: the reason for the strikes in progress
+    CourseId wipedOut;            // the course whose domain ran dry in propagate()
+    NogoodCache nogoods;          // conflict sets learned as nogoods (--nogoods=N)
+    vector<NogoodCache::Literal> nogood;
+    unsigned long long backjumps; // levels skipped
+    unsigned long long pruned;    // slots cut by a nogood
+};
+
+template<typename Tree>
+void backtrack(Search& search, Tree& avl, int x);
+CourseId nextCourse(Search& search, int x);
+int orderSlots(Search& search, CourseId course, pair<int, int>* tries);
+void place(Search& search, CourseId course, int slot);
+void unplace(Search& search, CourseId course, int slot);
+bool propagate(Search& search, CourseId course, int slot);
+bool strike(Search& search, CourseId course, int slot, const ConflictGraph::Word* reason);
+void explainClosed(Search& search, CourseId course, ConflictGraph::Word* conflictSet);
+void explainWipeOut(Search& search, ConflictGraph::Word* conflictSet);
+bool ruledOut(Search& search, CourseId course, int slot, ConflictGraph::Word* conflictSet);
+void learn(Search& search, const ConflictGraph::Word* conflictSet);
+void undoTo(Search& search, size_t mark);
+int domainSize(const Search& search, CourseId course);
+template<typename Key, typename Value, typename Alloc>
+void reserveNodes(AVLTree<Key, Value, Alloc>& avl, size_t n);
+template<typename Tree>
+void reserveNodes(Tree& avl, size_t n);
+template<typename Tree, typename Recurse>
+void descend(Tree& avl, CourseId course, int slot, Recurse recurse);
+template<typename Key, typename Value, typename Recurse>
+void descend(PersistentAVLTree<Key, Value>& avl, CourseId course, int slot, Recurse recurse);
 
 int main(int argc, char* argv[]){
 
@@ -18,6 +160,62 @@ int main(int argc, char* argv[]){
     string file = argv[1];
     ifstr.open(file);
 
+    bool stats = false;
+    CourseOrder courseOrder = FILE_ORDER;
+    SlotOrder slotOrder = ASCENDING;
+    Propagation propagation = NO_PROPAGATION;
+    bool backjumping = false;
+    size_t nogoodCapacity = 0;
+    for (int a = 2; a < argc; a++) {
+        string option = argv[a];
+        if (option == "--stats") {
+            stats = true;
+        }
+        else if (option == "--order=file") {
+            courseOrder = FILE_ORDER;
+        }
+        else if (option == "--order=degree") {
+            courseOrder = MAX_DEGREE;
+        }
+        else if (option == "--order=mrv") {
+            courseOrder = MRV;
+        }
+        else if (option == "--order=dsatur") {
+            courseOrder = DSATUR;
+        }
+        else if (option == "--values=ascending") {
+            slotOrder = ASCENDING;
+        }
+        else if (option == "--values=lcv") {
+            slotOrder = LEAST_CONSTRAINING;
+        }
+        else if (option == "--propagate=none") {
+            propagation = NO_PROPAGATION;
+        }
+        else if (option == "--propagate=fc") {
+            propagation = FORWARD_CHECKING;
+        }
+        else if (option == "--propagate=ac3") {
+            propagation = ARC_CONSISTENCY;
+        }
+        else if (option == "--backjump") {
+            backjumping = true;
+        }
+        else if (option.compare(0, 10, "--nogoods=") == 0) {
+            // nogoods come from the conflict sets, so this turns on backjumping too
+            stringstream number(option.substr(10));
+            if (!(number >> nogoodCapacity) || !number.eof()) {
+                cout << "Unknown option " << option << "!" << endl;
+                return 1;
+            }
+            backjumping = true;
+        }
+        else {
+            cout << "Unknown option " << option << "!" << endl;
+            return 1;
+        }
+    }
+
 	if (!ifstr) {
 		cout << "Cannot open " << file << "!" << endl;
 		return 1;
@@ -26,85 +224,474 @@ int main(int argc, char* argv[]){
     int classes, students, slots;
     ifstr >> classes >> students >> slots;
 
-    vector<set<string>*> schedule;
-    vector<string> courses;
-    AVLTree<string, int> avl;
-    bool check = false;
+    vector<CourseId> courses;
+    StringInterner names;
+    CourseTree avl;
 
     // reading in the classes 
     string temp;
     getline(ifstr, temp);
 
+    vector<vector<CourseId> > enrolled;
     int i = 0; 
     while (i < students) {
         getline(ifstr, temp);
         stringstream ss(temp);
         string studentClass;
-        set<string>* student = new set<string>;
+        vector<CourseId> student;
         string studentName;
         ss >> studentName;
         while (ss >> studentClass) {
-            if (find(courses.begin(), courses.end(), studentClass) == courses.end()) {
-                courses.push_back(studentClass);
+            size_t known = names.size();
+            CourseId id = names.intern(studentClass);
+            if (names.size() != known) {
+                courses.push_back(id);
             }
-            student->insert(studentClass);
+            student.push_back(id);
         }
-        schedule.push_back(student);
+        enrolled.push_back(student);
         i++; 
     }
 
-    backtrack(schedule, courses, avl, check, classes, students, slots, 0);
+    // number the courses in name order so the tree lists them that way
+    vector<CourseId> remap = names.sortIds();
+    for (size_t j = 0; j < courses.size(); j++) {
+        courses[j] = remap[courses[j]];
+    }
+
+    // two courses conflict when some student takes both
+    ConflictGraph conflicts(names.size());
+    for (size_t j = 0; j < enrolled.size(); j++) {
+        for (size_t k = 0; k < enrolled[j].size(); k++) {
+            enrolled[j][k] = remap[enrolled[j][k]];
+        }
+        conflicts.addClique(enrolled[j].begin(), enrolled[j].end());
+    }
+
+    // The search is done once it has placed as many courses as the header
+    // says there are, and everything it keeps is sized by the courses the
+    // students actually take. A header count past those would run it off the
+    // end, so schedule the courses there are; with no slots, none fits.
+    if (classes < 0 || classes > static_cast<int>(courses.size())) {
+        classes = courses.size();
+    }
+    if (slots < 0) {
+        slots = 0;
+    }
+
+    Search search(conflicts, courses, names, classes, slots, courseOrder, slotOrder, propagation,
+                  backjumping, nogoodCapacity);
+    reserveNodes(avl, courses.size());
+
+#ifdef SCHEDULER_COUNT_ALLOCS
+    unsigned long long allocationsBefore = heapAllocations;
+#endif
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    backtrack(search, avl, 0);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+#ifdef SCHEDULER_COUNT_ALLOCS
+    unsigned long long allocations = heapAllocations - allocationsBefore;
+#endif
 
-    if (check == false) {
+    if (search.check == false) {
         cout << "No Valid Solution." << endl;
     }
 
+    if (stats) {
+        cerr << "nodes: " << search.nodes << endl;
+        cerr << "time: " << seconds << " s" << endl;
+        if (backjumping) {
+            cerr << "backjumps: " << search.backjumps << endl;
+            cerr << "nogood prunes: " << search.pruned << endl;
+        }
+#ifdef SCHEDULER_COUNT_ALLOCS
+        cerr << "allocations in search: " << allocations << " ("
+             << (search.nodes == 0 ? 0.0 : double(allocations) / search.nodes) << " per node)" << endl;
+#endif
+    }
+
     return 0;
 }
 
-void backtrack(vector<set<string>*> schedule, vector<string> courses, AVLTree<string, int>& avl, bool& check, int classes, int students, int slots, int x) {
+Search::Search(const ConflictGraph& conflicts, const vector<CourseId>& courses, const StringInterner& names,
+               int classes, int slots, CourseOrder courseOrder, SlotOrder slotOrder, Propagation propagation,
+               bool backjumping, size_t nogoodCapacity) :
+    conflicts(conflicts), names(names), classes(classes), slots(slots),
+    courseOrder(courseOrder), slotOrder(slotOrder), propagation(propagation), backjumping(backjumping),
+    counting(courseOrder == MRV || courseOrder == DSATUR || slotOrder == LEAST_CONSTRAINING),
+    slotWords((slots + 63) / 64), order(courses),
+    occupied(slots * conflicts.words(), 0), unplaced(conflicts.words(), 0),
+    blocked(counting ? conflicts.vertices() * slots : 0, 0), saturation(conflicts.vertices(), 0),
+    tries((courses.size() + 1) * slots), check(false), nodes(0),
+    domains(propagation != NO_PROPAGATION ? conflicts.vertices() * slotWords : 0, 0),
+    trail(propagation != NO_PROPAGATION ? conflicts.vertices() * slots : 0), trailSize(0),
+    pending(propagation == ARC_CONSISTENCY ? conflicts.vertices() : 0),
+    slotOf(conflicts.vertices(), 0), placedAt(conflicts.vertices(), 0), placed(0),
+    conflictSets(backjumping ? (courses.size() + 1) * conflicts.words() : 0, 0),
+    reasons(backjumping && propagation != NO_PROPAGATION ? conflicts.vertices() * slots * conflicts.words() : 0, 0),
+    because(conflicts.words(), 0), wipedOut(0),
+    nogoods(conflicts.vertices(), slots, nogoodCapacity, maxNogoodLength), nogood(maxNogoodLength),
+    backjumps(0), pruned(0) {
+
+    for (size_t j = 0; j < courses.size(); j++) {
+        ConflictGraph::insert(&unplaced[0], courses[j]);
+    }
+    for (size_t c = 0; c < conflicts.vertices() && propagation != NO_PROPAGATION; c++) {
+        for (int i = 1; i <= slots; i++) {
+            ConflictGraph::insert(&domains[c * slotWords], i - 1);
+        }
+    }
+    if (courseOrder == MAX_DEGREE) {
+        stable_sort(order.begin(), order.end(), [&](CourseId a, CourseId b) {
+            return conflicts.degree(a) > conflicts.degree(b);
+        });
+    }
+}
+
+template<typename Tree>
+void backtrack(Search& search, Tree& avl, int x) {
     
-    if (check == true) return;
+    if (search.check == true) return;
 
-    if (x == classes) {
-        check = true;
+    if (x == search.classes) {
+        search.check = true;
         for (auto it = avl.begin(); it != avl.end(); ++it) {
-            string first = it->first;
+            const string& first = search.names.name(it->first);
             int second = it->second; 
             cout << first << " " << second << endl; 
         }
         return;
     }
 
-    string course = courses[x];
-    slots++; 
-    for (int i = 1; i < slots; i++) {
-        bool insert = true;
-        for (auto it = avl.begin(); it!=avl.end(); ++it) {
-            helper(it, i, students, schedule, courses, course, insert); 
-        }
-        
-        if (insert == true) {
-            pair<string, int> item(course, i); 
-            avl.insert(item);
-            backtrack(schedule, courses, avl, check,  classes, students, slots, x+1);
-            avl.remove(course);
-        }   
-    }
-}
-
-void helper(AVLTree<string,int>::iterator it, int i, int students, vector<set<string>*>& schedule, vector<string>& courses, string course, bool& insert) {
-    string curr = it->first;
-    int sec = it->second; 
-    if (sec == i) {
-        for (int j = 0; j < students; j++) {
-            bool has_course = false; // if it already has course 
-            bool has_curr = false; // if it already has curr 
-            for (auto it = schedule[j]->begin(); it != schedule[j]->end(); ++it) {
-                if (*it == course) has_course = true;
-                if (*it == curr) has_curr = true;
+    CourseId course = nextCourse(search, x);
+    size_t words = search.conflicts.words();
+    ConflictGraph::Word* conflictSet = search.backjumping ? &search.conflictSets[x * words] : NULL;
+    ConflictGraph::Word* childSet = search.backjumping ? &search.conflictSets[(x + 1) * words] : NULL;
+    if (search.backjumping) explainClosed(search, course, conflictSet);
+
+    pair<int, int>* tries = &search.tries[x * search.slots];
+    int count = orderSlots(search, course, tries);
+    for (int t = 0; t < count; t++) {
+        int i = tries[t].second;
+        if (search.backjumping && ruledOut(search, course, i, conflictSet)) continue;
+        search.nodes++;
+        place(search, course, i);
+        size_t mark = search.trailSize;
+        if (propagate(search, course, i)) {
+            descend(avl, course, i, [&](Tree& next) {
+                backtrack(search, next, x+1);
+            });
+        }
+        else if (search.backjumping) {
+            explainWipeOut(search, childSet);
+        }
+        undoTo(search, mark);
+        unplace(search, course, i);
+        if (search.check == true) return;
+
+        if (search.backjumping) {
+            if (!ConflictGraph::contains(childSet, course)) {
+                // this slot had nothing to do with the failure below, so no other will
+                copy(childSet, childSet + words, conflictSet);
+                search.backjumps++;
+                return;
             }
-            if (has_course == true && has_curr == true) insert = false;
-        } 
+            for (size_t w = 0; w < words; w++) {
+                conflictSet[w] |= childSet[w];
+            }
+            ConflictGraph::erase(conflictSet, course);
+        }
+    }
+    if (search.backjumping) learn(search, conflictSet);
+}
+
+// The course to place at depth x.
+CourseId nextCourse(Search& search, int x) {
+    if (search.courseOrder == FILE_ORDER || search.courseOrder == MAX_DEGREE) {
+        return search.order[x];
     }
+
+    // MRV and DSATUR both want the course with the most blocked slots, as the
+    // open slots are the ones not blocked. They differ on ties.
+    const ConflictGraph& conflicts = search.conflicts;
+    const ConflictGraph::Word* unplaced = &search.unplaced[0];
+    CourseId best = 0;
+    int bestSaturation = -1;
+    int bestDegree = -1;
+    for (size_t j = 0; j < search.order.size(); j++) {
+        CourseId course = search.order[j];
+        if (!ConflictGraph::contains(unplaced, course)) continue;
+        // with propagation the domain can be smaller than the unblocked slots
+        int saturation = search.saturation[course];
+        if (search.courseOrder == MRV && search.propagation != NO_PROPAGATION) {
+            saturation = search.slots - domainSize(search, course);
+        }
+        if (saturation < bestSaturation) continue;
+        if (search.courseOrder == MRV) {
+            if (saturation == bestSaturation) continue;
+        }
+        else {
+            // the conflicts that are still to be placed
+            const ConflictGraph::Word* row = conflicts.neighbours(course);
+            int degree = 0;
+            for (size_t w = 0; w < conflicts.words(); w++) {
+                degree += ConflictGraph::popcount(row[w] & unplaced[w]);
+            }
+            if (saturation == bestSaturation && degree <= bestDegree) continue;
+            bestDegree = degree;
+        }
+        best = course;
+        bestSaturation = saturation;
+    }
+    return best;
+}
+
+// Fills tries with the open slots for course in the order to try them and
+// returns how many there are.
+int orderSlots(Search& search, CourseId course, pair<int, int>* tries) {
+    const ConflictGraph& conflicts = search.conflicts;
+    int count = 0;
+    for (int i = 1; i <= search.slots; i++) {
+        if (search.propagation != NO_PROPAGATION) {
+            if (!ConflictGraph::contains(&search.domains[course * search.slotWords], i - 1)) continue;
+        }
+        else {
+            // a course fits in a slot if nothing it clashes with is there already
+            const ConflictGraph::Word* slot = &search.occupied[(i - 1) * conflicts.words()];
+            if (conflicts.hasNeighbourIn(course, slot)) continue;
+        }
+
+        int score = 0;
+        if (search.slotOrder == LEAST_CONSTRAINING) {
+            // how many unplaced conflicting courses would lose this slot
+            const ConflictGraph::Word* unplaced = &search.unplaced[0];
+            conflicts.forEach(conflicts.neighbours(course), [&](size_t other) {
+                if (!ConflictGraph::contains(unplaced, other)) return;
+                bool open = search.propagation != NO_PROPAGATION
+                    ? ConflictGraph::contains(&search.domains[other * search.slotWords], i - 1)
+                    : search.blocked[other * search.slots + i - 1] == 0;
+                if (open) score++;
+            });
+        }
+        tries[count++] = make_pair(score, i);
+    }
+    if (search.slotOrder == LEAST_CONSTRAINING) {
+        sort(tries, tries + count);
+    }
+    return count;
+}
+
+// Puts course in slot, updating the counts the heuristics read.
+void place(Search& search, CourseId course, int slot) {
+    ConflictGraph::insert(&search.occupied[(slot - 1) * search.conflicts.words()], course);
+    ConflictGraph::erase(&search.unplaced[0], course);
+    search.slotOf[course] = slot;
+    search.placedAt[course] = search.placed++;
+    if (!search.counting) return;
+    search.conflicts.forEach(search.conflicts.neighbours(course), [&](size_t other) {
+        if (search.blocked[other * search.slots + slot - 1]++ == 0) search.saturation[other]++;
+    });
+}
+
+// Undoes place(search, course, slot).
+void unplace(Search& search, CourseId course, int slot) {
+    ConflictGraph::erase(&search.occupied[(slot - 1) * search.conflicts.words()], course);
+    ConflictGraph::insert(&search.unplaced[0], course);
+    search.slotOf[course] = 0;
+    search.placed--;
+    if (!search.counting) return;
+    search.conflicts.forEach(search.conflicts.neighbours(course), [&](size_t other) {
+        if (--search.blocked[other * search.slots + slot - 1] == 0) search.saturation[other]--;
+    });
+}
+
+// Strikes slot from the domains of the unplaced courses that clash with
+// course, which has just been placed there. With AC-3, a course left with a
+// single slot then strikes that slot from its own unplaced conflicts, and so on
+// until nothing changes. Returns false if some domain runs dry, and leaves
+// that course in search.wipedOut. Everything struck is recorded on the trail
+// for undoTo().
+bool propagate(Search& search, CourseId course, int slot) {
+    if (search.propagation == NO_PROPAGATION) return true;
+
+    size_t words = search.conflicts.words();
+    ConflictGraph::Word* because = &search.because[0];
+    if (search.backjumping) {
+        // the first round of strikes is down to course alone
+        fill(because, because + words, 0);
+        ConflictGraph::insert(because, course);
+    }
+    size_t head = 0;
+    size_t tail = 0;
+    CourseId from = course;
+    int taken = slot;
+    while (true) {
+        bool ok = true;
+        search.conflicts.forEach(search.conflicts.neighbours(from), [&](size_t other) {
+            if (!ok || !ConflictGraph::contains(&search.unplaced[0], other)) return;
+            if (!strike(search, other, taken, because)) return;
+            int left = domainSize(search, other);
+            if (left == 0) {
+                search.wipedOut = other;
+                ok = false;
+            }
+            else if (left == 1 && search.propagation == ARC_CONSISTENCY) {
+                const ConflictGraph::Word* domain = &search.domains[other * search.slotWords];
+                int only = 1;
+                while (!ConflictGraph::contains(domain, only - 1)) only++;
+                search.pending[tail++] = make_pair(other, only);
+            }
+        });
+        if (!ok) return false;
+        if (head == tail) return true;
+        from = search.pending[head].first;
+        taken = search.pending[head].second;
+        head++;
+        if (search.backjumping) {
+            // from is left with taken only because of whatever struck its other slots
+            fill(because, because + words, 0);
+            for (int i = 1; i <= search.slots; i++) {
+                if (i == taken) continue;
+                const ConflictGraph::Word* reason = &search.reasons[(from * search.slots + i - 1) * words];
+                for (size_t w = 0; w < words; w++) {
+                    because[w] |= reason[w];
+                }
+            }
+        }
+    }
+}
+
+// Removes slot from course's domain and records it, unless it was already gone.
+// With backjumping, reason is kept as the placed courses that forced it out.
+bool strike(Search& search, CourseId course, int slot, const ConflictGraph::Word* reason) {
+    ConflictGraph::Word* domain = &search.domains[course * search.slotWords];
+    if (!ConflictGraph::contains(domain, slot - 1)) return false;
+    ConflictGraph::erase(domain, slot - 1);
+    search.trail[search.trailSize++] = make_pair(course, slot);
+    if (search.backjumping) {
+        size_t words = search.conflicts.words();
+        copy(reason, reason + words, &search.reasons[(course * search.slots + slot - 1) * words]);
+    }
+    return true;
+}
+
+// Starts the conflict set of the level placing course with the placed courses
+// that already close some of its slots.
+void explainClosed(Search& search, CourseId course, ConflictGraph::Word* conflictSet) {
+    const ConflictGraph& conflicts = search.conflicts;
+    size_t words = conflicts.words();
+    fill(conflictSet, conflictSet + words, 0);
+    for (int i = 1; i <= search.slots; i++) {
+        if (search.propagation != NO_PROPAGATION) {
+            if (ConflictGraph::contains(&search.domains[course * search.slotWords], i - 1)) continue;
+            const ConflictGraph::Word* reason = &search.reasons[(course * search.slots + i - 1) * words];
+            for (size_t w = 0; w < words; w++) {
+                conflictSet[w] |= reason[w];
+            }
+        }
+        else {
+            // any one conflicting course in slot i closes it; blaming the one
+            // placed first lets the search jump back the furthest
+            const ConflictGraph::Word* row = conflicts.neighbours(course);
+            const ConflictGraph::Word* slot = &search.occupied[(i - 1) * words];
+            ConflictGraph::Word* clashing = &search.because[0];
+            for (size_t w = 0; w < words; w++) {
+                clashing[w] = row[w] & slot[w];
+            }
+            int first = -1;
+            conflicts.forEach(clashing, [&](size_t other) {
+                if (first == -1 || search.placedAt[other] < search.placedAt[first]) first = other;
+            });
+            if (first != -1) ConflictGraph::insert(conflictSet, first);
+        }
+    }
+}
+
+// The conflict set for a placement whose propagation wiped out a domain: the
+// placed courses that struck each of its slots.
+void explainWipeOut(Search& search, ConflictGraph::Word* conflictSet) {
+    size_t words = search.conflicts.words();
+    fill(conflictSet, conflictSet + words, 0);
+    for (int i = 1; i <= search.slots; i++) {
+        const ConflictGraph::Word* reason = &search.reasons[(search.wipedOut * search.slots + i - 1) * words];
+        for (size_t w = 0; w < words; w++) {
+            conflictSet[w] |= reason[w];
+        }
+    }
+}
+
+// Whether putting course in slot would complete a learned nogood. If so, the
+// rest of the nogood joins the conflict set.
+bool ruledOut(Search& search, CourseId course, int slot, ConflictGraph::Word* conflictSet) {
+    size_t length = 0;
+    const NogoodCache::Literal* nogood = search.nogoods.completed(course, slot - 1, [&](CourseId other) {
+        return search.slotOf[other] - 1;
+    }, length);
+    if (nogood == NULL) return false;
+    for (size_t j = 0; j < length; j++) {
+        if (nogood[j].first != course) ConflictGraph::insert(conflictSet, nogood[j].first);
+    }
+    search.pruned++;
+    return true;
+}
+
+// A level that ran out of slots proves that the courses in its conflict set
+// cannot keep their present slots together; keeps that as a nogood if short.
+void learn(Search& search, const ConflictGraph::Word* conflictSet) {
+    if (search.nogoods.capacity() == 0) return;
+    size_t length = 0;
+    bool fits = true;
+    search.conflicts.forEach(conflictSet, [&](size_t course) {
+        if (length == maxNogoodLength) {
+            fits = false;
+            return;
+        }
+        search.nogood[length++] = NogoodCache::Literal(course, search.slotOf[course] - 1);
+    });
+    if (fits) search.nogoods.add(&search.nogood[0], length);
+}
+
+// Puts back every slot struck since the trail was mark long.
+void undoTo(Search& search, size_t mark) {
+    while (search.trailSize > mark) {
+        pair<CourseId, int> struck = search.trail[--search.trailSize];
+        ConflictGraph::insert(&search.domains[struck.first * search.slotWords], struck.second - 1);
+    }
+}
+
+int domainSize(const Search& search, CourseId course) {
+    const ConflictGraph::Word* domain = &search.domains[course * search.slotWords];
+    int size = 0;
+    for (size_t w = 0; w < search.slotWords; w++) {
+        size += ConflictGraph::popcount(domain[w]);
+    }
+    return size;
+}
+
+// Makes room for n courses up front, so the search never allocates tree nodes.
+template<typename Key, typename Value, typename Alloc>
+void reserveNodes(AVLTree<Key, Value, Alloc>& avl, size_t n) {
+    avl.reserve(n);
+}
+
+// Other trees allocate as they go.
+template<typename Tree>
+void reserveNodes(Tree&, size_t) {
+
+}
+
+// Runs recurse on the assignment extended with course -> slot, and puts the
+// tree back the way it was afterwards.
+template<typename Tree, typename Recurse>
+void descend(Tree& avl, CourseId course, int slot, Recurse recurse) {
+    avl.insert_or_assign(course, slot);
+    recurse(avl);
+    avl.remove(course);
+}
+
+// A persistent tree keeps the old version as it was, so there is nothing to undo.
+template<typename Key, typename Value, typename Recurse>
+void descend(PersistentAVLTree<Key, Value>& avl, CourseId course, int slot, Recurse recurse) {
+    PersistentAVLTree<Key, Value> next = avl.insert_or_assign(course, slot);
+    recurse(next);
 }
@@ -0,0 +1,587 @@
+#include "avlbst.h"
+#include "persistent.h"
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Random inserts and removes on AVLTree, checking after every step that the
+// tree is still a valid AVL tree (parent links, stored heights, balance, subtree
+// sizes, key order) and holds exactly what a std::map given the same steps does,
+// with select() and rank() agreeing with the map's order. Then the same
+// checks after split/join, range erase and the set operations, serial and
+// parallel, against the std:: set algorithms, and after batched inserts and
+// removes. Frozen copies must answer lookups exactly as the tree they came from,
+// range(), equal_range() and prefixRange() must pick out the same runs as
+// std::map, and every version of a persistent tree must keep its own contents
+// however the versions after it change.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        if (failures < 20) cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+// Lets the test walk the nodes, which the tree keeps to itself.
+template<typename Alloc>
+class CheckedTree : public AVLTree<int, int, Alloc>
+{
+public:
+    typedef AVLTree<int, int, Alloc> Base;
+
+    AVLNode<int, int>* root() const {
+        return static_cast<AVLNode<int, int>*>(this->root_);
+    }
+
+    // Splits the whole tree at key, passes the detached pieces (lower, the node
+    // holding key or NULL, upper) to checkPieces, and joins them back.
+    template<typename CheckPieces>
+    void splitAndJoin(int key, CheckPieces checkPieces) {
+        AVLNode<int, int>* lower;
+        AVLNode<int, int>* upper;
+        AVLNode<int, int>* found = Base::split(root(), key, lower, upper);
+        if (lower != NULL) lower->setParent(NULL);
+        if (upper != NULL) upper->setParent(NULL);
+        checkPieces(lower, found, upper);
+        AVLNode<int, int>* joined = found != NULL ? Base::join(lower, found, upper) : Base::join2(lower, upper);
+        if (joined != NULL) joined->setParent(NULL);
+        this->root_ = joined;
+        this->rethread(joined);
+    }
+};
+
+// Returns the height of the subtree, checking every node in it. Keys must lie
+// strictly between lo and hi where those are given.
+static int checkNode(AVLNode<int, int>* node, AVLNode<int, int>* parent,
+                     const int* lo, const int* hi, const string& where) {
+    if (node == NULL) return 0;
+    check(node->getParent() == parent, where + ": parent link");
+    check(lo == NULL || *lo < node->getKey(), where + ": key order");
+    check(hi == NULL || node->getKey() < *hi, where + ": key order");
+    int left = checkNode(node->getLeft(), node, lo, &node->getKey(), where);
+    int right = checkNode(node->getRight(), node, &node->getKey(), hi, where);
+    int height = 1 + max(left, right);
+    check(node->getHeight() == height, where + ": stored height");
+    check(left - right <= 1 && right - left <= 1, where + ": balance factor");
+    unsigned int size = 1;
+    if (node->getLeft() != NULL) size += node->getLeft()->getSize();
+    if (node->getRight() != NULL) size += node->getRight()->getSize();
+    check(node->getSize() == size, where + ": subtree size");
+    return height;
+}
+
+template<typename Alloc>
+static void checkTree(const CheckedTree<Alloc>& tree, const map<int, int>& model, const string& where) {
+    checkNode(tree.root(), NULL, NULL, NULL, where);
+    check(tree.size() == model.size(), where + ": size()");
+    check(tree.empty() == model.empty(), where + ": empty()");
+    check(tree.isBalanced(), where + ": isBalanced()");
+
+    // forwards and backwards, against the model
+    map<int, int>::const_iterator expected = model.begin();
+    for (typename CheckedTree<Alloc>::const_iterator it = tree.begin(); it != tree.end(); ++it) {
+        if (expected == model.end()) {
+            check(false, where + ": extra items");
+            break;
+        }
+        check(it->first == expected->first && it->second == expected->second, where + ": contents");
+        ++expected;
+    }
+    check(expected == model.end(), where + ": missing items");
+
+    map<int, int>::const_reverse_iterator back = model.rbegin();
+    for (typename CheckedTree<Alloc>::const_reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it) {
+        if (back == model.rend()) break;
+        check(it->first == back->first, where + ": reverse contents");
+        ++back;
+    }
+
+    // select(k) is the k-th item, and rank() counts the keys below any key, present or not
+    size_t k = 0;
+    for (map<int, int>::const_iterator it = model.begin(); it != model.end(); ++it, k++) {
+        typename CheckedTree<Alloc>::iterator selected = tree.select(k);
+        check(selected != tree.end() && selected->first == it->first, where + ": select");
+        check(tree.rank(it->first) == k, where + ": rank of a key");
+        check(tree.rank(it->first + 1) == k + 1, where + ": rank just above a key");
+    }
+    check(tree.select(model.size()) == tree.end(), where + ": select(size())");
+    check(tree.select(model.size() + 5) == tree.end(), where + ": select past the end");
+    check(tree.select(static_cast<size_t>(-1)) == tree.end(), where + ": select(-1)");
+    check(tree.rank(-1) == 0, where + ": rank below every key");
+    check(tree.rank(1 << 30) == model.size(), where + ": rank above every key");
+}
+
+template<typename Alloc>
+static void stress(unsigned int seed, int steps, int keys, const string& name) {
+    mt19937 random(seed);
+    CheckedTree<Alloc> tree;
+    map<int, int> model;
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(random() % keys);
+        int value = static_cast<int>(random() % 1000);
+        string where = name + " seed " + to_string(seed) + " step " + to_string(step);
+        switch (random() % 4) {
+        case 0:
+            tree.insert(make_pair(key, value));
+            model[key] = value;
+            break;
+        case 1:
+            tree.insert_or_assign(key, value);
+            model[key] = value;
+            break;
+        default:
+            // removes as often as inserts, including keys that are not there
+            tree.remove(key);
+            model.erase(key);
+            break;
+        }
+        checkTree(tree, model, where);
+        check((tree.find(key) != tree.end()) == (model.count(key) == 1), where + ": find");
+    }
+
+    // and empty it again in key order and in random order
+    vector<int> left;
+    for (map<int, int>::const_iterator it = model.begin(); it != model.end(); ++it) left.push_back(it->first);
+    shuffle(left.begin(), left.end(), random);
+    for (size_t i = 0; i < left.size(); i++) {
+        tree.remove(left[i]);
+        model.erase(left[i]);
+        checkTree(tree, model, name + " draining");
+    }
+    check(tree.root() == NULL, name + ": empty root");
+}
+
+template<typename Alloc>
+static void splitJoin(unsigned int seed, int n, const string& name) {
+    mt19937 random(seed);
+    CheckedTree<Alloc> tree;
+    map<int, int> model;
+    for (int i = 0; i < n; i++) {
+        int key = static_cast<int>(random() % (4 * n));
+        tree.insert(make_pair(key, i));
+        model[key] = i;
+    }
+    for (int round = 0; round < 50; round++) {
+        int key = static_cast<int>(random() % (4 * n + 2)) - 1;
+        string where = name + " split at " + to_string(key);
+        tree.splitAndJoin(key, [&](AVLNode<int, int>* lower, AVLNode<int, int>* found, AVLNode<int, int>* upper) {
+            checkNode(lower, NULL, NULL, &key, where + " lower");
+            checkNode(upper, NULL, &key, NULL, where + " upper");
+            check((found != NULL) == (model.count(key) == 1), where + ": found");
+            check(found == NULL || (found->getKey() == key && found->getLeft() == NULL && found->getRight() == NULL),
+                  where + ": detached node");
+            size_t below = distance(model.begin(), model.lower_bound(key));
+            check((lower == NULL ? 0 : lower->getSize()) == below, where + ": lower size");
+            check((upper == NULL ? 0 : upper->getSize()) == model.size() - below - (found != NULL),
+                  where + ": upper size");
+        });
+        checkTree(tree, model, where + " joined");
+    }
+
+    // erase(lo, hi) is two splits and a join
+    for (int round = 0; round < 20 && !model.empty(); round++) {
+        int lo = static_cast<int>(random() % (4 * n));
+        int hi = lo + static_cast<int>(random() % (n / 2 + 1));
+        size_t expected = distance(model.lower_bound(lo), model.lower_bound(hi));
+        model.erase(model.lower_bound(lo), model.lower_bound(hi));
+        check(tree.erase(lo, hi) == expected, name + ": erase count");
+        checkTree(tree, model, name + " erase [" + to_string(lo) + ", " + to_string(hi) + ")");
+    }
+}
+
+template<typename Alloc>
+static void randomTree(mt19937& random, int n, int keys, int tag, CheckedTree<Alloc>& tree, map<int, int>& model) {
+    for (int i = 0; i < n; i++) {
+        int key = static_cast<int>(random() % keys);
+        tree.insert(make_pair(key, tag + i));
+        model[key] = tag + i;
+    }
+}
+
+static vector<int> keysOf(const map<int, int>& model) {
+    vector<int> keys;
+    for (map<int, int>::const_iterator it = model.begin(); it != model.end(); ++it) keys.push_back(it->first);
+    return keys;
+}
+
+// Both trees drawn from the same key range so they overlap; this tree's
+// values are kept wherever both have a key.
+template<typename Alloc>
+static void setOperations(unsigned int seed, int n1, int n2, int keys, bool parallel, const string& name) {
+    for (int op = 0; op < 3; op++) {
+        mt19937 random(seed);
+        CheckedTree<Alloc> a;
+        CheckedTree<Alloc> b;
+        map<int, int> modelA;
+        map<int, int> modelB;
+        randomTree(random, n1, keys, 0, a, modelA);
+        randomTree(random, n2, keys, 1000000, b, modelB);
+        vector<int> keysA = keysOf(modelA);
+        vector<int> keysB = keysOf(modelB);
+        vector<int> expected;
+        string where = name + (parallel ? " parallel" : " serial") + " seed " + to_string(seed);
+        if (op == 0) {
+            set_union(keysA.begin(), keysA.end(), keysB.begin(), keysB.end(), back_inserter(expected));
+            a.unionWith(b, parallel);
+            where += " union";
+        }
+        else if (op == 1) {
+            set_intersection(keysA.begin(), keysA.end(), keysB.begin(), keysB.end(), back_inserter(expected));
+            a.intersectWith(b, parallel);
+            where += " intersection";
+        }
+        else {
+            set_difference(keysA.begin(), keysA.end(), keysB.begin(), keysB.end(), back_inserter(expected));
+            a.differenceWith(b, parallel);
+            where += " difference";
+        }
+        map<int, int> result;
+        for (size_t i = 0; i < expected.size(); i++) {
+            result[expected[i]] = modelA.count(expected[i]) == 1 ? modelA[expected[i]] : modelB[expected[i]];
+        }
+        checkTree(a, result, where);
+        checkTree(b, modelB, where + ", other tree untouched");
+
+        // with itself, union and intersection change nothing and difference empties it
+        CheckedTree<Alloc> c(b);
+        if (op == 0) c.unionWith(c, parallel);
+        else if (op == 1) c.intersectWith(c, parallel);
+        else c.differenceWith(c, parallel);
+        checkTree(c, op == 2 ? map<int, int>() : modelB, where + " with itself");
+    }
+}
+
+// A batch of inserts and then a batch of removes on a tree of n items, both
+// drawn from the same key range, so batches repeat keys and hit keys already in
+// the tree. The model applies them one at a time, later duplicates winning.
+template<typename Alloc>
+static void batches(unsigned int seed, int n, int batch, int keys, bool parallel, const string& name) {
+    mt19937 random(seed);
+    CheckedTree<Alloc> tree;
+    map<int, int> model;
+    randomTree(random, n, keys, 0, tree, model);
+    string where = name + (parallel ? " parallel" : " serial") + " seed " + to_string(seed)
+        + ", " + to_string(n) + " items, batch of " + to_string(batch);
+
+    vector<pair<int, int> > inserts;
+    for (int i = 0; i < batch; i++) {
+        int key = static_cast<int>(random() % keys);
+        inserts.push_back(make_pair(key, 1000000 + i));
+        model[key] = 1000000 + i;
+    }
+    tree.insertBatch(inserts.begin(), inserts.end(), parallel);
+    checkTree(tree, model, where + " inserted");
+
+    vector<int> removes;
+    for (int i = 0; i < batch; i++) {
+        int key = static_cast<int>(random() % (keys + keys / 4));
+        removes.push_back(key);
+        model.erase(key);
+    }
+    tree.removeBatch(removes.begin(), removes.end(), parallel);
+    checkTree(tree, model, where + " removed");
+}
+
+// Freezes a tree of n keys (even numbers, so every gap is probed too) and
+// compares every lookup with the source tree.
+template<typename Alloc>
+static void freeze(unsigned int seed, int n, const string& name) {
+    mt19937 random(seed);
+    CheckedTree<Alloc> tree;
+    vector<int> keys;
+    for (int i = 0; i < n; i++) keys.push_back(2 * i);
+    shuffle(keys.begin(), keys.end(), random);
+    for (int i = 0; i < n; i++) tree.insert(make_pair(keys[i], static_cast<int>(random() % 1000)));
+
+    FrozenTree<int, int> frozen = tree.freeze();
+    string where = name + " frozen size " + to_string(n);
+    check(frozen.size() == tree.size() && frozen.empty() == tree.empty(), where + ": size");
+    typename CheckedTree<Alloc>::const_iterator it = tree.begin();
+    for (FrozenTree<int, int>::const_iterator f = frozen.begin(); f != frozen.end(); ++f, ++it) {
+        check(it != tree.end() && f->first == it->first && f->second == it->second, where + ": contents");
+    }
+    check(it == tree.end(), where + ": missing items");
+
+    for (int key = -2; key <= 2 * n + 1; key++) {
+        typename CheckedTree<Alloc>::iterator found = tree.find(key);
+        FrozenTree<int, int>::const_iterator frozenFound = frozen.find(key);
+        check((found == tree.end()) == (frozenFound == frozen.end()), where + ": find " + to_string(key));
+        if (found != tree.end() && frozenFound != frozen.end()) {
+            check(frozenFound->first == key && frozenFound->second == found->second, where + ": find value");
+        }
+        typename CheckedTree<Alloc>::iterator lower = tree.lower_bound(key);
+        FrozenTree<int, int>::const_iterator frozenLower = frozen.lower_bound(key);
+        check((lower == tree.end()) == (frozenLower == frozen.end()), where + ": lower_bound " + to_string(key));
+        if (lower != tree.end() && frozenLower != frozen.end()) {
+            check(frozenLower->first == lower->first, where + ": lower_bound key");
+        }
+        typename CheckedTree<Alloc>::iterator upper = tree.upper_bound(key);
+        FrozenTree<int, int>::const_iterator frozenUpper = frozen.upper_bound(key);
+        check((upper == tree.end()) == (frozenUpper == frozen.end()), where + ": upper_bound " + to_string(key));
+        if (upper != tree.end() && frozenUpper != frozen.end()) {
+            check(frozenUpper->first == upper->first, where + ": upper_bound key");
+        }
+    }
+
+    // the snapshot does not follow later changes
+    tree.insert(make_pair(-10, 0));
+    check(frozen.find(-10) == frozen.end() && frozen.size() + 1 == tree.size(), where + ": independent of the tree");
+}
+
+// Whether [first, last) holds exactly the keys of [expected, expectedEnd).
+template<typename Iterator, typename ModelIterator>
+static bool sameRun(Iterator first, Iterator last, ModelIterator expected, ModelIterator expectedEnd) {
+    for (; first != last; ++first, ++expected) {
+        if (expected == expectedEnd || first->first != expected->first) return false;
+    }
+    return expected == expectedEnd;
+}
+
+// range(lo, hi) and equal_range(key) on a tree of keys spread over [0, keys),
+// for intervals that are empty, inverted, inside it, or past either end.
+template<typename Alloc>
+static void intRanges(unsigned int seed, int n, int keys, const string& name) {
+    mt19937 random(seed);
+    CheckedTree<Alloc> tree;
+    map<int, int> model;
+    randomTree(random, n, keys, 0, tree, model);
+    string where = name + " ranges, " + to_string(model.size()) + " keys";
+
+    vector<int> ends;
+    for (int key = -3; key <= keys + 3; key++) ends.push_back(key);
+    bool ranges = true;
+    bool emptyWhenNotBelow = true;
+    for (size_t i = 0; i < ends.size(); i++) {
+        for (size_t j = 0; j < ends.size(); j += 1 + random() % 5) {
+            int lo = ends[i];
+            int hi = ends[j];
+            typename CheckedTree<Alloc>::range_view view = tree.range(lo, hi);
+            if (lo < hi) {
+                ranges = ranges && sameRun(view.begin(), view.end(), model.lower_bound(lo), model.lower_bound(hi));
+                ranges = ranges && view.empty() == (model.lower_bound(lo) == model.lower_bound(hi));
+            }
+            else {
+                emptyWhenNotBelow = emptyWhenNotBelow && view.empty() && view.begin() == tree.end();
+            }
+        }
+    }
+    check(ranges, where + ": range(lo, hi)");
+    check(emptyWhenNotBelow, where + ": range(lo, hi) with hi <= lo is empty");
+
+    bool equal = true;
+    for (size_t i = 0; i < ends.size(); i++) {
+        pair<typename CheckedTree<Alloc>::iterator, typename CheckedTree<Alloc>::iterator> run = tree.equal_range(ends[i]);
+        pair<map<int, int>::const_iterator, map<int, int>::const_iterator> modelRun = model.equal_range(ends[i]);
+        equal = equal && sameRun(run.first, run.second, modelRun.first, modelRun.second);
+        equal = equal && (run.second == tree.end()) == (modelRun.second == model.end());
+    }
+    check(equal, where + ": equal_range");
+
+    // the whole tree, and everything from a key to the end
+    if (!model.empty()) {
+        typename CheckedTree<Alloc>::range_view all = tree.range(-1, keys);
+        check(all.begin() == tree.begin() && all.end() == tree.end(), where + ": range over everything");
+        int last = model.rbegin()->first;
+        typename CheckedTree<Alloc>::range_view tail = tree.range(last, keys + 10);
+        check(tail.begin() != tail.end() && tail.begin()->first == last && tail.end() == tree.end(),
+              where + ": range ending past the largest key");
+    }
+}
+
+// prefixRange() and PrefixOf/PrefixLess on course-like string keys, against a
+// std::map filtered by hand.
+template<typename Alloc>
+static void prefixRanges(const string& name) {
+    const char* courses[] = {"CS101", "CS102", "CS103", "CS201", "CS270", "EE101", "EE2", "MATH125", "MATH126"};
+    AVLTree<string, int, Alloc> tree;
+    map<string, int> model;
+    const char* prefixes[] = {"", "C", "CS", "CS1", "CS10", "CS101", "CS1015", "CS2", "CS3", "E", "EE2", "EE20",
+                              "A", "Z", "MATH", "MATH12", "MATH126", "MATH127", "MATH1266"};
+    for (size_t c = 0; c <= sizeof(courses) / sizeof(courses[0]); c++) {
+        // every prefix again after each insert, from the empty tree up
+        for (size_t p = 0; p < sizeof(prefixes) / sizeof(prefixes[0]); p++) {
+            string prefix = prefixes[p];
+            map<string, int> expected;
+            for (map<string, int>::const_iterator it = model.begin(); it != model.end(); ++it) {
+                if (it->first.compare(0, prefix.size(), prefix) == 0) expected.insert(*it);
+            }
+            string where = name + " " + to_string(model.size()) + " keys, prefix \"" + prefix + "\"";
+            typename AVLTree<string, int, Alloc>::range_view view = tree.prefixRange(prefix);
+            check(sameRun(view.begin(), view.end(), expected.begin(), expected.end()), where + ": prefixRange");
+            check(view.empty() == expected.empty(), where + ": prefixRange empty()");
+            bool atEnd = !expected.empty() && expected.rbegin()->first == (model.empty() ? "" : model.rbegin()->first);
+            check(!atEnd || view.end() == tree.end(), where + ": a run of the last keys ends at end()");
+
+            PrefixOf<string> of(prefix);
+            pair<typename AVLTree<string, int, Alloc>::iterator, typename AVLTree<string, int, Alloc>::iterator> run =
+                tree.equal_range(of, PrefixLess());
+            check(run.first == view.begin() && run.second == view.end(), where + ": equal_range with PrefixLess");
+            check(tree.lower_bound(of, PrefixLess()) == view.begin(), where + ": lower_bound with PrefixLess");
+            check(tree.upper_bound(of, PrefixLess()) == view.end(), where + ": upper_bound with PrefixLess");
+            typename AVLTree<string, int, Alloc>::iterator found = tree.find(of, PrefixLess());
+            check(expected.empty() ? found == tree.end() : found != tree.end() && expected.count(found->first) == 1,
+                  where + ": find with PrefixLess");
+        }
+        if (c < sizeof(courses) / sizeof(courses[0])) {
+            tree.insert(make_pair(string(courses[c]), static_cast<int>(c)));
+            model[courses[c]] = static_cast<int>(c);
+        }
+    }
+}
+
+typedef PersistentAVLTree<int, int> Persistent;
+
+static void checkVersion(const Persistent& version, const map<int, int>& model, int keys, const string& where) {
+    check(version.isValid(), where + ": isValid()");
+    check(version.size() == model.size() && version.empty() == model.empty(), where + ": size()");
+    map<int, int>::const_iterator expected = model.begin();
+    for (Persistent::iterator it = version.begin(); it != version.end(); ++it, ++expected) {
+        if (expected == model.end() || it->first != expected->first || it->second != expected->second) break;
+    }
+    check(expected == model.end(), where + ": contents");
+    bool found = true;
+    for (int key = -1; key <= keys; key++) {
+        Persistent::iterator it = version.find(key);
+        map<int, int>::const_iterator modelIt = model.find(key);
+        found = found && (it == version.end() ? modelIt == model.end()
+                          : modelIt != model.end() && it->first == key && it->second == modelIt->second);
+    }
+    check(found, where + ": find");
+}
+
+// Whether two versions are made of the very same nodes: nothing was copied.
+static bool sameNodes(const Persistent& a, const Persistent& b) {
+    Persistent::iterator it = a.begin();
+    Persistent::iterator other = b.begin();
+    for (; it != a.end() && other != b.end(); ++it, ++other) {
+        if (&*it != &*other) return false;
+    }
+    return it == a.end() && other == b.end();
+}
+
+// Random updates, each making a new version of a PersistentAVLTree. Every so
+// often the current version is kept along with a copy of the model, and all
+// the kept versions are checked against their copies again.
+static void persistentVersions(unsigned int seed, int steps, int keys) {
+    mt19937 random(seed);
+    Persistent current;
+    map<int, int> model;
+    vector<pair<Persistent, map<int, int> > > kept;
+    string name = "persistent seed " + to_string(seed);
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(random() % keys);
+        int value = static_cast<int>(random() % 1000);
+        string where = name + " step " + to_string(step);
+        Persistent before = current;
+        if (random() % 2 == 0) {
+            current = current.insert_or_assign(key, value);
+            model[key] = value;
+        }
+        else {
+            bool present = model.erase(key) == 1;
+            current = current.remove(key);
+            // removing a key that is not there copies nothing
+            check(present || sameNodes(before, current), where + ": remove of a missing key shares the root");
+        }
+        checkVersion(current, model, keys, where);
+
+        if (step % 50 == 0) {
+            // keep up to eight versions, replacing a random one when full
+            if (kept.size() < 8) kept.push_back(make_pair(current, model));
+            else kept[random() % kept.size()] = make_pair(current, model);
+            for (size_t v = 0; v < kept.size(); v++) {
+                checkVersion(kept[v].first, kept[v].second, keys, where + ", kept version " + to_string(v));
+            }
+        }
+    }
+
+    // an empty tree, and emptying one, leave the earlier versions alone too
+    Persistent empty;
+    check(empty.isValid() && empty.empty() && empty.remove(0).empty(), name + ": empty");
+    for (map<int, int>::const_iterator it = model.begin(); it != model.end(); ++it) current = current.remove(it->first);
+    checkVersion(current, map<int, int>(), keys, name + " emptied");
+    for (size_t v = 0; v < kept.size(); v++) {
+        checkVersion(kept[v].first, kept[v].second, keys, name + " after emptying, kept version " + to_string(v));
+    }
+}
+
+int main() {
+    for (unsigned int seed = 1; seed <= 20; seed++) {
+        stress<NodeArena>(seed, 2000, 64 << (seed % 4), "arena");
+        stress<HeapAlloc>(seed, 2000, 64 << (seed % 4), "heap");
+    }
+    // sequential keys drive the same rotation over and over
+    CheckedTree<NodeArena> tree;
+    map<int, int> model;
+    for (int i = 0; i < 3000; i++) {
+        tree.insert(make_pair(i, i));
+        model[i] = i;
+    }
+    checkTree(tree, model, "ascending");
+    for (int i = 0; i < 3000; i += 2) {
+        tree.remove(i);
+        model.erase(i);
+    }
+    checkTree(tree, model, "every other removed");
+
+    for (unsigned int seed = 1; seed <= 5; seed++) {
+        splitJoin<NodeArena>(seed, 50 * seed * seed, "arena");
+        splitJoin<HeapAlloc>(seed, 50 * seed * seed, "heap");
+    }
+    for (unsigned int seed = 1; seed <= 10; seed++) {
+        // empty, tiny, lopsided and equal-sized inputs
+        int n1 = seed == 1 ? 0 : static_cast<int>(seed * seed * 20);
+        int n2 = seed == 2 ? 0 : static_cast<int>(2000 / seed);
+        setOperations<NodeArena>(seed, n1, n2, 3000, false, "arena");
+        setOperations<HeapAlloc>(seed, n1, n2, 3000, false, "heap");
+    }
+    // big enough to fork past the parallel cutoff
+    setOperations<NodeArena>(11, 60000, 50000, 150000, false, "large");
+    setOperations<NodeArena>(11, 60000, 50000, 150000, true, "large");
+    setOperations<HeapAlloc>(12, 40000, 80000, 150000, true, "large heap");
+
+    // empty batches and trees, batches small enough to go in key by key, and
+    // batches of mostly duplicates
+    int batchCases[][3] = {
+        {0, 0, 100}, {0, 500, 1000}, {500, 0, 1000}, {1, 1, 1}, {3000, 10, 5000},
+        {3000, 40, 5000}, {3000, 47, 5000}, {2000, 2000, 3000}, {100, 3000, 200}, {1000, 5000, 20}
+    };
+    for (unsigned int c = 0; c < sizeof(batchCases) / sizeof(batchCases[0]); c++) {
+        batches<NodeArena>(c + 1, batchCases[c][0], batchCases[c][1], batchCases[c][2], false, "arena");
+        batches<HeapAlloc>(c + 1, batchCases[c][0], batchCases[c][1], batchCases[c][2], false, "heap");
+    }
+    batches<NodeArena>(20, 60000, 40000, 100000, false, "large");
+    batches<NodeArena>(20, 60000, 40000, 100000, true, "large");
+
+    // empty, one key, every complete Eytzinger layout up to 2^12 - 1, and the sizes around them
+    for (int k = 0; k <= 12; k++) {
+        int full = (1 << k) - 1;
+        freeze<NodeArena>(k + 1, full, "arena");
+        freeze<NodeArena>(k + 1, full + 1, "arena");
+        if (full > 0) freeze<HeapAlloc>(k + 1, full - 1, "heap");
+    }
+    freeze<NodeArena>(99, 12345, "arena");
+
+    // empty trees, single keys, and sparse and dense ones
+    intRanges<NodeArena>(1, 0, 20, "arena");
+    intRanges<NodeArena>(2, 1, 20, "arena");
+    intRanges<HeapAlloc>(3, 10, 40, "heap");
+    intRanges<NodeArena>(4, 200, 100, "arena");
+    prefixRanges<NodeArena>("arena");
+    prefixRanges<HeapAlloc>("heap");
+
+    for (unsigned int seed = 1; seed <= 10; seed++) {
+        persistentVersions(seed, 1500, 32 << (seed % 4));
+    }
+
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "avl_stress: all checks passed" << endl;
+    return 0;
+}
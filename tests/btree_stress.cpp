@@ -0,0 +1,171 @@
+#include "btree.h"
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Random inserts, assignments and removes on BPlusTree with nodes of only a few
+// keys, so leaves and inner nodes split, borrow from a sibling and merge every
+// few steps and the root grows and shrinks. After every step the tree must
+// pass isValid() and answer find, lower_bound, upper_bound and a full walk in
+// both directions exactly as a std::map given the same steps does.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        if (failures < 20) cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+template<typename Tree>
+static void checkTree(const Tree& tree, const map<int, int>& model, int keys, const string& where) {
+    check(tree.isValid(), where + ": isValid()");
+    check(tree.size() == model.size(), where + ": size()");
+    check(tree.empty() == model.empty(), where + ": empty()");
+
+    map<int, int>::const_iterator expected = model.begin();
+    for (typename Tree::const_iterator it = tree.begin(); it != tree.end(); ++it) {
+        if (expected == model.end()) {
+            check(false, where + ": extra items");
+            break;
+        }
+        if (it->first != expected->first || it->second != expected->second) break;
+        ++expected;
+    }
+    check(expected == model.end(), where + ": contents");
+
+    map<int, int>::const_reverse_iterator back = model.rbegin();
+    for (typename Tree::const_reverse_iterator it = tree.rbegin(); it != tree.rend(); ++it) {
+        if (back == model.rend()) {
+            check(false, where + ": extra items in reverse");
+            break;
+        }
+        if (it->first != back->first) break;
+        ++back;
+    }
+    check(back == model.rend(), where + ": reverse contents");
+
+    // every key in range and one past either end, present or not
+    bool found = true;
+    bool lower = true;
+    bool upper = true;
+    for (int key = -1; key <= keys; key++) {
+        typename Tree::iterator it = tree.find(key);
+        map<int, int>::const_iterator modelIt = model.find(key);
+        found = found && (it == tree.end() ? modelIt == model.end()
+                          : modelIt != model.end() && it->first == key && it->second == modelIt->second);
+        it = tree.lower_bound(key);
+        modelIt = model.lower_bound(key);
+        lower = lower && (it == tree.end() ? modelIt == model.end()
+                          : modelIt != model.end() && it->first == modelIt->first);
+        it = tree.upper_bound(key);
+        modelIt = model.upper_bound(key);
+        upper = upper && (it == tree.end() ? modelIt == model.end()
+                          : modelIt != model.end() && it->first == modelIt->first);
+    }
+    check(found, where + ": find");
+    check(lower, where + ": lower_bound");
+    check(upper, where + ": upper_bound");
+}
+
+template<typename Tree>
+static void stress(unsigned int seed, int steps, int keys, const string& name) {
+    mt19937 random(seed);
+    Tree tree;
+    map<int, int> model;
+    for (int step = 0; step < steps; step++) {
+        int key = static_cast<int>(random() % keys);
+        int value = static_cast<int>(random() % 1000);
+        string where = name + " seed " + to_string(seed) + " step " + to_string(step);
+        switch (random() % 4) {
+        case 0:
+            tree.insert(make_pair(key, value));
+            model[key] = value;
+            break;
+        case 1: {
+            pair<typename Tree::iterator, bool> result = tree.insert_or_assign(key, value);
+            check(result.second == (model.count(key) == 0), where + ": insert_or_assign inserted");
+            check(result.first != tree.end() && result.first->first == key && result.first->second == value,
+                  where + ": insert_or_assign iterator");
+            model[key] = value;
+            break;
+        }
+        default:
+            // removes as often as inserts, including keys that are not there
+            tree.remove(key);
+            model.erase(key);
+            break;
+        }
+        checkTree(tree, model, keys, where);
+    }
+}
+
+// Fills the tree far past one level in ascending, descending or random order,
+// then takes it apart again, so the root splits on the way up and shrinks back
+// into a single leaf, and finally into nothing, on the way down.
+template<typename Tree>
+static void growAndDrain(unsigned int seed, int n, int order, const string& name) {
+    mt19937 random(seed);
+    vector<int> keys;
+    for (int i = 0; i < n; i++) keys.push_back(i);
+    if (order == 1) reverse(keys.begin(), keys.end());
+    if (order == 2) shuffle(keys.begin(), keys.end(), random);
+
+    Tree tree;
+    map<int, int> model;
+    string where = name + " order " + to_string(order) + ", " + to_string(n) + " keys";
+    for (int i = 0; i < n; i++) {
+        tree.insert(make_pair(keys[i], i));
+        model[keys[i]] = i;
+        check(tree.isValid(), where + ": isValid() growing");
+    }
+    checkTree(tree, model, n, where + " full");
+
+    // drain from the end it was filled from last, ascending or descending, or at random
+    shuffle(keys.begin(), keys.end(), random);
+    if (order != 2) sort(keys.begin(), keys.end());
+    if (order == 0) reverse(keys.begin(), keys.end());
+    for (int i = 0; i < n; i++) {
+        tree.remove(keys[i]);
+        model.erase(keys[i]);
+        check(tree.isValid(), where + ": isValid() draining");
+        if (i % 97 == 0) checkTree(tree, model, n, where + " draining");
+    }
+    checkTree(tree, model, n, where + " drained");
+    check(tree.begin() == tree.end(), where + ": empty");
+
+    // and it fills up again from nothing
+    tree.insert(make_pair(1, 1));
+    model[1] = 1;
+    checkTree(tree, model, n, where + " refilled");
+}
+
+template<typename Tree>
+static void run(const string& name) {
+    for (unsigned int seed = 1; seed <= 10; seed++) {
+        stress<Tree>(seed, 2000, 16 << (seed % 4), name);
+    }
+    for (int order = 0; order < 3; order++) {
+        growAndDrain<Tree>(order + 1, 2000, order, name);
+    }
+}
+
+int main() {
+    // the smallest nodes allowed, an odd size whose halves differ, and a few levels of 8
+    run<BPlusTree<int, int, NodeArena, 4> >("NodeKeys 4/NodeArena");
+    run<BPlusTree<int, int, HeapAlloc, 4> >("NodeKeys 4/HeapAlloc");
+    run<BPlusTree<int, int, NodeArena, 5> >("NodeKeys 5/NodeArena");
+    run<BPlusTree<int, int, NodeArena, 8> >("NodeKeys 8/NodeArena");
+
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "btree_stress: all checks passed" << endl;
+    return 0;
+}
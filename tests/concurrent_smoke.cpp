@@ -0,0 +1,100 @@
+#include "concurrent.h"
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Reader threads search and walk snapshots of a ConcurrentAVLTree while writer
+// threads fill it and empty part of it again, then the final contents are
+// checked. Built with ThreadSanitizer (make test), so an unsynchronised publish
+// or a reader touching a freed version fails the run.
+
+static const int writers = 2;
+static const int readers = 4;
+static const int keysPerWriter = 1500;
+
+static atomic<int> failures(0);
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        if (failures < 20) cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+// Every value ever stored is 10 times its key, so any half-built version shows up.
+static void write(ConcurrentAVLTree<int, int>& map, int writer) {
+    for (int i = 0; i < keysPerWriter; i++) {
+        int key = i * writers + writer;
+        map.insert_or_assign(key, key * 10);
+    }
+    for (int i = 0; i < keysPerWriter; i += 3) {
+        map.remove(i * writers + writer);
+    }
+}
+
+static void read(const ConcurrentAVLTree<int, int>& map, const atomic<int>& writing, int reader) {
+    unsigned int probe = static_cast<unsigned int>(reader);
+    do {
+        // a snapshot is one consistent version: sorted, sized right, no torn values
+        ConcurrentAVLTree<int, int>::Snapshot snapshot = map.snapshot();
+        size_t count = 0;
+        int last = -1;
+        for (ConcurrentAVLTree<int, int>::Snapshot::iterator it = snapshot.begin(); it != snapshot.end(); ++it) {
+            check(it->first > last, "snapshot order");
+            check(it->second == it->first * 10, "snapshot value");
+            last = it->first;
+            count++;
+        }
+        check(count == snapshot.size(), "snapshot size");
+
+        for (int i = 0; i < 200; i++) {
+            probe = probe * 1103515245 + 12345;
+            int key = static_cast<int>((probe >> 8) % (writers * keysPerWriter));
+            int value = -1;
+            if (map.find(key, value)) check(value == key * 10, "find value");
+            map.contains(key);
+        }
+    } while (writing > 0);
+}
+
+int main() {
+    ConcurrentAVLTree<int, int> map;
+    atomic<int> writing(writers);
+    vector<thread> threads;
+    for (int r = 0; r < readers; r++) {
+        threads.push_back(thread(read, cref(map), cref(writing), r));
+    }
+    for (int w = 0; w < writers; w++) {
+        threads.push_back(thread([&map, &writing, w]() {
+            write(map, w);
+            writing--;
+        }));
+    }
+    for (size_t t = 0; t < threads.size(); t++) {
+        threads[t].join();
+    }
+
+    // each writer kept the keys whose index is not a multiple of 3
+    size_t expected = 0;
+    for (int w = 0; w < writers; w++) {
+        for (int i = 0; i < keysPerWriter; i++) {
+            int key = i * writers + w;
+            int value = -1;
+            bool found = map.find(key, value);
+            check(found == (i % 3 != 0), "final contents");
+            check(!found || value == key * 10, "final value");
+            if (i % 3 != 0) expected++;
+        }
+    }
+    check(map.size() == expected, "final size");
+
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "concurrent_smoke: all checks passed" << endl;
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include "key_traits.h"
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Checks KeyTraits<Key>::lowerIndex/upperIndex against std::lower_bound and
+// std::upper_bound on sorted runs of every length up to a few vector windows,
+// with and without repeated keys, probing every key present, the gaps between
+// them and both extremes of the type. make test builds it four ways: plain,
+// and with BST_SIMD_KEYS for SSE2, SSE4.2 and AVX2, so each search kernel in
+// key_traits.h is compared with the standard algorithms.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        if (failures < 20) cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+template<typename Key>
+static void searchRun(const vector<Key>& keys, const vector<Key>& probes, const string& where) {
+    bool lower = true;
+    bool upper = true;
+    for (size_t i = 0; i < probes.size(); i++) {
+        size_t expectedLower = std::lower_bound(keys.begin(), keys.end(), probes[i]) - keys.begin();
+        size_t expectedUpper = std::upper_bound(keys.begin(), keys.end(), probes[i]) - keys.begin();
+        lower = lower && KeyTraits<Key>::lowerIndex(keys.data(), keys.size(), probes[i]) == expectedLower;
+        upper = upper && KeyTraits<Key>::upperIndex(keys.data(), keys.size(), probes[i]) == expectedUpper;
+    }
+    check(lower, where + ": lowerIndex");
+    check(upper, where + ": upperIndex");
+}
+
+// Sorted runs of n keys from makeKey(random), drawn from a narrow range so runs
+// of equal keys turn up, or a wide one so they mostly do not.
+template<typename Key, typename MakeKey>
+static void searches(const string& name, MakeKey makeKey, const vector<Key>& extremes) {
+    mt19937 random(1);
+    vector<size_t> sizes;
+    for (size_t n = 0; n <= 70; n++) sizes.push_back(n);
+    sizes.push_back(100);
+    sizes.push_back(257);
+    sizes.push_back(1000);
+
+    for (size_t s = 0; s < sizes.size(); s++) {
+        for (int narrow = 0; narrow < 2; narrow++) {
+            for (int round = 0; round < 20; round++) {
+                vector<Key> keys;
+                for (size_t i = 0; i < sizes[s]; i++) keys.push_back(makeKey(random, narrow == 1));
+                sort(keys.begin(), keys.end());
+
+                vector<Key> probes(extremes);
+                for (size_t i = 0; i < keys.size(); i++) probes.push_back(keys[i]);
+                for (size_t i = 0; i < 2 * keys.size() + 10; i++) probes.push_back(makeKey(random, narrow == 1));
+                searchRun(keys, probes, name + ", " + to_string(sizes[s]) + " keys"
+                          + (narrow == 1 ? " with repeats" : ""));
+            }
+        }
+    }
+}
+
+// Strings over a few letters, '\0'-free, up to N long: the empty string, every
+// length in between and full ones, so the zero padding is compared too.
+template<size_t N>
+static string randomString(mt19937& random, bool narrow) {
+    size_t length = random() % (N + 1);
+    string s;
+    for (size_t i = 0; i < length; i++) s.push_back(static_cast<char>((narrow ? 'a' : 1) + random() % (narrow ? 3 : 255)));
+    return s;
+}
+
+template<size_t N>
+static void fixedStrings(const string& name) {
+    // packing keeps the characters and orders exactly as std::string does
+    mt19937 random(2);
+    bool roundTrip = true;
+    bool order = true;
+    for (int i = 0; i < 20000; i++) {
+        string a = randomString<N>(random, i % 2 == 0);
+        string b = randomString<N>(random, i % 2 == 0);
+        FixedString<N> fa(a);
+        FixedString<N> fb(b);
+        roundTrip = roundTrip && fa.str() == a && fa.size() == a.size();
+        order = order && (fa < fb) == (a < b) && (fa == fb) == (a == b);
+    }
+    check(roundTrip, name + ": str() gives back the string");
+    check(order, name + ": order matches std::string");
+    bool threw = false;
+    try {
+        FixedString<N> tooLong(string(N + 1, 'x'));
+    }
+    catch (const length_error&) {
+        threw = true;
+    }
+    check(threw, name + ": too long a string throws length_error");
+
+    vector<FixedString<N> > extremes;
+    extremes.push_back(FixedString<N>());
+    extremes.push_back(FixedString<N>(string(N, '\xff')));
+    searches<FixedString<N> >(name, [](mt19937& random, bool narrow) {
+        return FixedString<N>(randomString<N>(random, narrow));
+    }, extremes);
+}
+
+// Integers spread over the whole type, so signed keys are negative about half
+// the time and unsigned keys have the top bit set about half the time.
+template<typename Int>
+static void integers(const string& name) {
+    vector<Int> extremes;
+    extremes.push_back(numeric_limits<Int>::min());
+    extremes.push_back(numeric_limits<Int>::max());
+    extremes.push_back(0);
+    searches<Int>(name, [](mt19937& random, bool narrow) {
+        if (narrow) return static_cast<Int>(static_cast<int>(random() % 16) - 8);
+        uint64_t bits = (static_cast<uint64_t>(random()) << 32) | random();
+        return static_cast<Int>(bits);
+    }, extremes);
+}
+
+int main() {
+    integers<int>("int");
+    integers<unsigned int>("unsigned int");
+    integers<int64_t>("int64_t");
+    integers<uint64_t>("uint64_t");
+    fixedStrings<8>("FixedString<8>");
+    fixedStrings<16>("FixedString<16>");
+    fixedStrings<5>("FixedString<5>");
+
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "key_search: all checks passed" << endl;
+    return 0;
+}
@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+// Runs the scheduler binary given on the command line (make test passes
+// ./scheduling) on random instances, small enough for the plain search and
+// about a third of them with too few slots, under every combination of --order,
+// --values, --propagate, --backjump and --nogoods, then on larger ones, where
+// backjumps and nogood prunes are common, under the options that do those.
+// Every schedule printed must be a valid one, every combination must agree on
+// whether there is one, and with a fixed course order and slots tried in
+// ascending order the pruning must not change which schedule is found first.
+// Small fixed inputs must get the schedule, or the number of placements,
+// worked out by hand for each --order, --values and --propagate, and unknown
+// options must be rejected.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        if (failures < 20) cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+struct Instance
+{
+    int slots;
+    vector<vector<string> > students;   // the courses each student takes
+    set<string> courses;
+};
+
+static string text(const Instance& instance) {
+    stringstream out;
+    out << instance.courses.size() << " " << instance.students.size() << " " << instance.slots << "\n";
+    for (size_t s = 0; s < instance.students.size(); s++) {
+        out << "s" << s;
+        for (size_t c = 0; c < instance.students[s].size(); c++) out << " " << instance.students[s][c];
+        out << "\n";
+    }
+    return out.str();
+}
+
+// Writes the input to a fresh temporary file and returns its name.
+static string writeInput(const string& input) {
+    char name[] = "/tmp/scheduling_checkXXXXXX";
+    int fd = mkstemp(name);
+    if (fd == -1) {
+        cout << "Cannot create a temporary file!" << endl;
+        exit(1);
+    }
+    close(fd);
+    ofstream file(name);
+    file << input;
+    return name;
+}
+
+// Everything command writes to its standard output, and its exit status.
+static string capture(const string& command, int& status) {
+    FILE* pipe = popen(command.c_str(), "r");
+    if (pipe == NULL) {
+        cout << "Cannot run " << command << "!" << endl;
+        exit(1);
+    }
+    string output;
+    char buffer[4096];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof(buffer), pipe)) > 0) output.append(buffer, got);
+    status = pclose(pipe);
+    return output;
+}
+
+// The scheduler's standard output for the input file, and its exit status.
+static string run(const string& binary, const string& file, const string& options, int& status) {
+    return capture(binary + " " + file + " " + options + " 2>/dev/null", status);
+}
+
+// Whether output is a valid schedule for instance: every course once, in name
+// order, in a slot from 1 to slots, and no student with two courses in one
+// slot. Sets feasible to whether it claims there is a schedule at all.
+static bool validSchedule(const Instance& instance, const string& output, bool& feasible) {
+    feasible = output != "No Valid Solution.\n";
+    if (!feasible) return true;
+
+    map<string, int> slotOf;
+    stringstream lines(output);
+    string line;
+    string last;
+    while (getline(lines, line)) {
+        stringstream fields(line);
+        string course;
+        int slot = 0;
+        string rest;
+        if (!(fields >> course >> slot) || fields >> rest) return false;
+        if (!last.empty() && !(last < course)) return false;
+        if (slot < 1 || slot > instance.slots) return false;
+        slotOf[course] = slot;
+        last = course;
+    }
+    if (slotOf.size() != instance.courses.size()) return false;
+    for (size_t s = 0; s < instance.students.size(); s++) {
+        set<int> taken;
+        for (size_t c = 0; c < instance.students[s].size(); c++) {
+            map<string, int>::const_iterator it = slotOf.find(instance.students[s][c]);
+            if (it == slotOf.end() || !taken.insert(it->second).second) return false;
+        }
+    }
+    return true;
+}
+
+static Instance randomInstance(mt19937& random, int maxCourses, int maxStudents) {
+    Instance instance;
+    int courses = 2 + static_cast<int>(random() % (maxCourses - 1));
+    int students = 1 + static_cast<int>(random() % maxStudents);
+    for (int s = 0; s < students; s++) {
+        // each student takes a few distinct courses
+        int takes = 1 + static_cast<int>(random() % 4);
+        vector<string> student;
+        for (int t = 0; t < takes; t++) {
+            string course = "c" + to_string(random() % courses);
+            if (find(student.begin(), student.end(), course) != student.end()) continue;
+            student.push_back(course);
+            instance.courses.insert(course);
+        }
+        instance.students.push_back(student);
+    }
+    // as many slots as the longest course list, or one more: either is
+    // sometimes enough and sometimes not
+    size_t most = 0;
+    for (size_t s = 0; s < instance.students.size(); s++) most = max(most, instance.students[s].size());
+    instance.slots = static_cast<int>(most + random() % 2);
+    return instance;
+}
+
+// Every combination of one option from each list, the order options first.
+static vector<string> optionSets(const vector<string>& orders, const vector<string>& values,
+                                 const vector<string>& propagations, const vector<string>& jumps) {
+    vector<string> sets;
+    for (size_t o = 0; o < orders.size(); o++) {
+        for (size_t v = 0; v < values.size(); v++) {
+            for (size_t p = 0; p < propagations.size(); p++) {
+                for (size_t j = 0; j < jumps.size(); j++) {
+                    sets.push_back(orders[o] + " " + values[v] + " " + propagations[p] + " " + jumps[j]);
+                }
+            }
+        }
+    }
+    return sets;
+}
+
+static void combinations(const string& binary, unsigned int seed, int instances, int maxCourses, int maxStudents,
+                         const vector<string>& sets) {
+    mt19937 random(seed);
+    int feasibleCount = 0;
+    for (int n = 0; n < instances; n++) {
+        Instance instance = randomInstance(random, maxCourses, maxStudents);
+        string file = writeInput(text(instance));
+        string where = "seed " + to_string(seed) + " instance " + to_string(n) + " (" + to_string(instance.courses.size()) + " courses, "
+            + to_string(instance.slots) + " slots)";
+
+        int status = 0;
+        bool expected = false;
+        string plain = run(binary, file, "", status);
+        check(status == 0 && validSchedule(instance, plain, expected), where + ": no options");
+        if (expected) feasibleCount++;
+
+        map<string, string> firstFound;   // by the order options, when those are fixed
+        for (size_t s = 0; s < sets.size(); s++) {
+            string output = run(binary, file, sets[s], status);
+            bool feasible = false;
+            check(status == 0 && validSchedule(instance, output, feasible), where + " " + sets[s] + ": valid");
+            check(feasible == expected, where + " " + sets[s] + ": agrees on whether there is a schedule");
+
+            // propagation, backjumping and nogoods only cut branches with no
+            // schedule in them, so a fixed search order still finds the same one
+            bool fixedOrder = sets[s].find("--values=ascending") != string::npos
+                && (sets[s].find("--order=file") != string::npos || sets[s].find("--order=degree") != string::npos);
+            if (fixedOrder) {
+                string order = sets[s].substr(0, sets[s].find(' '));
+                if (firstFound.count(order) == 0) firstFound[order] = output;
+                check(output == firstFound[order], where + " " + sets[s] + ": same schedule as without pruning");
+            }
+        }
+        check(firstFound["--order=file"] == plain, where + ": --order=file is the default");
+        remove(file.c_str());
+    }
+    // the generator should give both kinds, or the agreement checks prove little
+    check(feasibleCount > instances / 5 && feasibleCount < instances - instances / 5,
+          "a mix of feasible and infeasible instances (" + to_string(feasibleCount) + " of "
+          + to_string(instances) + " feasible)");
+}
+
+// Runs the scheduler on input with options and compares its output with expected.
+static void expectOutput(const string& binary, const string& input, const string& options, const string& expected,
+                         const string& what) {
+    string file = writeInput(input);
+    int status = 0;
+    string output = run(binary, file, options, status);
+    check(status == 0 && output == expected, what + " (" + options + "): got\n" + output);
+    remove(file.c_str());
+}
+
+// An option the scheduler does not know stops it before it reads the input.
+static void expectRejected(const string& binary, const string& option) {
+    string file = writeInput("1 1 1\ns0 a\n");
+    int status = 0;
+    string output = run(binary, file, option, status);
+    check(status != 0 && output == "Unknown option " + option + "!\n", "rejects " + option);
+    remove(file.c_str());
+}
+
+// Seven courses in three slots, small enough to follow each heuristic by hand.
+// Courses first appear in the order 103 107 105 101 104 106 102; 105 has the
+// most conflicts, then 101, 104 and 102.
+static const char* const sevenCourses =
+    "7 6 3\n"
+    "alice CS103 CS107\n"
+    "bob CS105 CS101 CS104\n"
+    "carol CS105 CS101 CS104\n"
+    "dave CS107 CS104\n"
+    "erin CS106 CS102 CS105\n"
+    "frank CS105 CS101 CS102\n";
+
+static void courseAndSlotOrders(const string& binary) {
+    // in file order, each course takes the lowest slot its placed conflicts leave
+    string fileOrder = "CS101 2\nCS102 3\nCS103 1\nCS104 3\nCS105 1\nCS106 2\nCS107 2\n";
+    expectOutput(binary, sevenCourses, "", fileOrder, "the default is file order, slots ascending");
+    expectOutput(binary, sevenCourses, "--order=file --values=ascending", fileOrder, "file order");
+    // 106 goes in slot 1, which 102 has already lost to 101, instead of slot 2
+    expectOutput(binary, sevenCourses, "--order=file --values=lcv",
+                 "CS101 1\nCS102 3\nCS103 1\nCS104 3\nCS105 2\nCS106 1\nCS107 2\n", "least constraining slot");
+    // 105 101 104 102 107 106 103; DSATUR only swaps 107 and 106, to the same schedule
+    string byDegree = "CS101 2\nCS102 3\nCS103 2\nCS104 3\nCS105 1\nCS106 2\nCS107 1\n";
+    expectOutput(binary, sevenCourses, "--order=degree", byDegree, "most conflicts first");
+    expectOutput(binary, sevenCourses, "--order=degree --values=lcv", byDegree, "most conflicts first");
+    expectOutput(binary, sevenCourses, "--order=dsatur", byDegree, "DSATUR");
+    expectOutput(binary, sevenCourses, "--order=dsatur --values=lcv", byDegree, "DSATUR");
+    // 103 107 104 105 101 102 106: after the first, always the course with the fewest slots left
+    string fewestLeft = "CS101 3\nCS102 1\nCS103 1\nCS104 1\nCS105 2\nCS106 3\nCS107 2\n";
+    expectOutput(binary, sevenCourses, "--order=mrv", fewestLeft, "fewest slots left first");
+    expectOutput(binary, sevenCourses, "--order=mrv --values=lcv", fewestLeft, "fewest slots left first");
+
+    expectRejected(binary, "--order=random");
+    expectRejected(binary, "--order");
+    expectRejected(binary, "--values=descending");
+    expectRejected(binary, "--values=");
+}
+
+// How many placements the search tried on input with options, from --stats.
+static long nodes(const string& binary, const string& input, const string& options) {
+    string file = writeInput(input);
+    int status = 0;
+    string stats = capture(binary + " " + file + " " + options + " --stats 2>&1 >/dev/null", status);
+    remove(file.c_str());
+    size_t at = stats.find("nodes: ");
+    return status == 0 && at != string::npos ? atol(stats.c_str() + at + 7) : -1;
+}
+
+// Three courses that all clash, in two slots, with an unrelated course d
+// placed between b and c. Each kind of propagation finds out sooner:
+//   none  a=1 b=2 d=1 d=2, then a=2 b=1 d=1 d=2, and c never fits: 8 placements
+//   fc    a=1 b=2 leaves c no slot, and the same from a=2: 4
+//   ac3   a=1 leaves b only slot 2, which b then strikes from c: 2
+static void propagation(const string& binary) {
+    const char* triangle = "4 4 2\ns0 a b\ns1 d\ns2 a c\ns3 b c\n";
+    const char* propagations[] = {"", "--propagate=none", "--propagate=fc", "--propagate=ac3"};
+    for (int p = 0; p < 4; p++) {
+        expectOutput(binary, triangle, propagations[p], "No Valid Solution.\n", "no schedule for a triangle in two slots");
+    }
+    check(nodes(binary, triangle, "") == 8, "no propagation by default");
+    check(nodes(binary, triangle, "--propagate=none") == 8, "--propagate=none tries d in both slots");
+    check(nodes(binary, triangle, "--propagate=fc") == 4, "--propagate=fc sees c has no slot left");
+    check(nodes(binary, triangle, "--propagate=ac3") == 2, "--propagate=ac3 sees it one level earlier");
+    check(nodes(binary, triangle, "--propagate=fc --propagate=none") == 8, "the last --propagate wins");
+
+    // propagation only prunes, so a schedule found without it is found with it
+    for (int p = 1; p < 4; p++) {
+        expectOutput(binary, sevenCourses, propagations[p],
+                     "CS101 2\nCS102 3\nCS103 1\nCS104 3\nCS105 1\nCS106 2\nCS107 2\n", "file order");
+    }
+
+    expectRejected(binary, "--propagate=ac4");
+    expectRejected(binary, "--propagate");
+}
+
+// Headers whose counts do not match the students that follow, and the slot
+// bound: each level of the search may only use slots 1 to slots.
+static void headerCounts(const string& binary) {
+    // more classes than the students take, or a negative count: schedule the ones they take
+    expectOutput(binary, "3 1 2\ns0 a\n", "", "a 1\n", "header with too many classes");
+    expectOutput(binary, "3 1 2\ns0 a\n", "--order=dsatur --values=lcv --propagate=ac3 --nogoods=8", "a 1\n",
+                 "header with too many classes");
+    expectOutput(binary, "-2 1 2\ns0 a\n", "", "a 1\n", "header with a negative class count");
+    // no slots, or fewer than none
+    expectOutput(binary, "2 1 0\ns0 a b\n", "", "No Valid Solution.\n", "header with no slots");
+    expectOutput(binary, "1 1 -1\ns0 a\n", "--propagate=fc", "No Valid Solution.\n", "header with negative slots");
+    // nothing to schedule is a valid, empty schedule
+    expectOutput(binary, "0 0 3\n", "", "", "no students");
+
+    // Three courses one student takes together do not fit in two slots. The
+    // search used to allow one more slot at each level, and printed a 1, b 2, c 3.
+    const char* tooFewSlots = "3 1 2\ns0 a b c\n";
+    expectOutput(binary, tooFewSlots, "", "No Valid Solution.\n", "three clashing courses in two slots");
+    expectOutput(binary, tooFewSlots, "--order=mrv --values=lcv", "No Valid Solution.\n",
+                 "three clashing courses in two slots");
+    expectOutput(binary, "3 1 3\ns0 a b c\n", "", "a 1\nb 2\nc 3\n", "three clashing courses in three slots");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        cout << "Usage: " << argv[0] << " path/to/scheduling" << endl;
+        return 1;
+    }
+    string binary = argv[1];
+
+    courseAndSlotOrders(binary);
+    propagation(binary);
+    headerCounts(binary);
+
+    vector<string> orders = {"--order=file", "--order=degree", "--order=mrv", "--order=dsatur"};
+    vector<string> values = {"--values=ascending", "--values=lcv"};
+    vector<string> propagations = {"--propagate=none", "--propagate=fc", "--propagate=ac3"};
+    combinations(binary, 1, 40, 14, 30, optionSets(orders, values, propagations, {"", "--backjump", "--nogoods=64"}));
+
+    // a cache small enough to overwrite nogoods all the time, and one that rarely does
+    combinations(binary, 2, 100, 20, 40, optionSets(orders, {"--values=ascending"}, {"--propagate=none", "--propagate=fc"},
+                                                    {"--backjump", "--nogoods=4", "--nogoods=1000"}));
+
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "scheduling_check: all checks passed" << endl;
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "avlbst.h"
+#include "btree.h"
+#include <cstring>
+#include <map>
+#include <random>
+#include <string>
+using namespace std;
+
+// Copies, moves, assigns, clears and destroys trees of every kind, with each
+// allocator, holding strings long enough to live on the heap. Built with
+// AddressSanitizer (make test), so a node or item that is leaked, freed twice
+// or used after being freed fails the run.
+
+static int failures = 0;
+
+static void check(bool ok, const string& what) {
+    if (!ok) {
+        if (failures < 20) cout << "FAILED: " << what << endl;
+        failures++;
+    }
+}
+
+// past any small-string buffer, so each item owns heap memory
+static string longString(int i) {
+    return "a string long enough to be allocated on the heap #" + to_string(i);
+}
+
+template<typename Tree>
+static bool same(Tree& tree, const map<string, string>& model) {
+    map<string, string>::const_iterator expected = model.begin();
+    for (typename Tree::iterator it = tree.begin(); it != tree.end(); ++it, ++expected) {
+        if (expected == model.end() || it->first != expected->first || it->second != expected->second) return false;
+    }
+    return expected == model.end();
+}
+
+template<typename Tree>
+static void fill(Tree& tree, map<string, string>& model, int n, unsigned int seed) {
+    mt19937 random(seed);
+    for (int i = 0; i < n; i++) {
+        string key = longString(static_cast<int>(random() % (2 * n)));
+        string value = longString(i);
+        tree.insert(make_pair(key, value));
+        model[key] = value;
+    }
+}
+
+template<typename Tree>
+static void lifetime(const string& name) {
+    map<string, string> model;
+    Tree original;
+    fill(original, model, 500, 1);
+    check(same(original, model), name + ": filled");
+
+    {
+        // copies are deep: changing one leaves the other alone
+        Tree copy(original);
+        check(same(copy, model), name + ": copy constructed");
+        copy.remove(model.begin()->first);
+        copy.insert(make_pair(longString(-1), longString(-1)));
+        check(same(original, model), name + ": original after changing the copy");
+    }
+
+    {
+        // assigning over a tree that already has nodes frees them
+        Tree assigned;
+        map<string, string> other;
+        fill(assigned, other, 300, 2);
+        assigned = original;
+        check(same(assigned, model), name + ": copy assigned");
+        Tree& alias = assigned;
+        assigned = alias;
+        check(same(assigned, model), name + ": self assigned");
+    }
+
+    {
+        // a moved-from tree is empty and still usable
+        Tree source(original);
+        Tree moved(std::move(source));
+        check(same(moved, model), name + ": move constructed");
+        check(source.begin() == source.end(), name + ": moved-from is empty");
+        map<string, string> reused;
+        fill(source, reused, 50, 3);
+        check(same(source, reused), name + ": moved-from reused");
+
+        Tree target;
+        map<string, string> other;
+        fill(target, other, 200, 4);
+        target = std::move(moved);
+        check(same(target, model), name + ": move assigned");
+    }
+
+    {
+        // clear() frees everything, and the tree fills up again afterwards
+        Tree cleared(original);
+        cleared.clear();
+        check(cleared.begin() == cleared.end(), name + ": cleared");
+        cleared.clear();
+        map<string, string> again;
+        fill(cleared, again, 400, 5);
+        check(same(cleared, again), name + ": refilled after clear");
+        for (map<string, string>::const_iterator it = again.begin(); it != again.end(); ++it) {
+            cleared.remove(it->first);
+        }
+        check(cleared.begin() == cleared.end(), name + ": emptied by remove");
+    }
+}
+
+// trim() after reset() frees every slab but the first: the first slot comes
+// round again, and filling past the first slab grows the arena afresh. Every
+// slot is written, so one handed out from a freed slab fails under ASan.
+static void arenaTrim() {
+    const size_t slot = 32;
+    NodeArena arena(slot, alignof(void*));
+    arena.trim();
+    void* first = arena.allocate();
+    for (int i = 1; i < 20000; i++) memset(arena.allocate(), 1, slot);
+    for (int round = 0; round < 2; round++) {
+        arena.reset();
+        arena.trim();
+        void* again = arena.allocate();
+        check(again == first, "NodeArena: trim() keeps the first slab");
+        for (int i = 1; i < 20000; i++) memset(arena.allocate(), 2, slot);
+    }
+    arena.reset();
+    arena.trim();
+    arena.reserve(5000);
+    for (int i = 0; i < 5000; i++) memset(arena.allocate(), 3, slot);
+}
+
+int main() {
+    arenaTrim();
+    lifetime<BinarySearchTree<string, string, NodeArena> >("BinarySearchTree/NodeArena");
+    lifetime<BinarySearchTree<string, string, HeapAlloc> >("BinarySearchTree/HeapAlloc");
+    lifetime<AVLTree<string, string, NodeArena> >("AVLTree/NodeArena");
+    lifetime<AVLTree<string, string, HeapAlloc> >("AVLTree/HeapAlloc");
+    lifetime<BPlusTree<string, string, NodeArena, 8> >("BPlusTree/NodeArena");
+    lifetime<BPlusTree<string, string, HeapAlloc, 8> >("BPlusTree/HeapAlloc");
+
+    if (failures != 0) {
+        cout << failures << " checks failed" << endl;
+        return 1;
+    }
+    cout << "tree_lifetime: all checks passed" << endl;
+    return 0;
+}